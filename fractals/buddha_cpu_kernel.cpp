@@ -0,0 +1,219 @@
+#include "buddha_cuda_kernel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// CPU build of the buddha_cuda_kernel.h API for machines without nvcc (the
+// Makefile picks it when nvcc is missing). cuda_generate_buddhabrot_hits
+// keeps the batch model: one call samples as much as one cuda kernel launch
+// and returns all the hits, spread over every hardware thread here.
+//
+// Like the cuda kernel a batch cannot be cancelled and only samples the
+// power 2 Mandelbrot orbit, so the worker threads stay the cpu sampler and
+// cuda_info() reports no device. Built with BUDDHA_CPU_BATCH
+// (make BUDDHA_BACKEND=cpu_batch) the batch stands in for one.
+
+using namespace std;
+
+// samples per call, the same as the <<<32,256>>> x 100 cuda launch
+const unsigned long long CPU_BATCH_SAMPLES = 32ull * 256 * 100;
+// samples iterated side by side by one thread
+const unsigned int CPU_LANES = 4;
+
+const char *buddha_backend(void) { return "cpu"; }
+
+int cuda_info(void) {
+#ifdef BUDDHA_CPU_BATCH
+  // the cpu thread pool stands in for one device
+  cout << "No CUDA built in: buddhabrot batches run on "
+       << max(1u, thread::hardware_concurrency()) << " cpu threads" << endl;
+  return 1;
+#else
+  cout << "No CUDA built in: buddhabrots sample on the worker threads" << endl;
+  return 0;
+#endif
+}
+
+int cuda_vec_add(unsigned int w, unsigned int h) {
+  cout << "CPU Test: vector add" << endl;
+  const unsigned int n = w * h;
+  vector<float> a(n, 1.1f);
+  vector<float> b(n, 2.2f);
+  vector<float> c(n, 0.0f);
+  for (unsigned int i = 0; i < n; ++i) c[i] = a[i] + b[i];
+  cout << "First and last elements of vector should be 3.3: " << c[0] << " "
+       << c[n - 1] << endl;
+  return 0;
+}
+
+int cuda_generate_hits_prototype(unsigned int w, unsigned int h) {
+  cout << "CPU Test: no hits prototype, cuda_generate_buddhabrot_hits is the "
+          "real thing" << endl;
+  return 0;
+}
+
+// main cardioid and period 2 bulb never escape
+static bool skipInSet_cpu(double x, double y) {
+  double q = (x - 0.25) * (x - 0.25) + y * y;
+  if (q * (q + (x - 0.25)) <= 0.25 * y * y) return true;
+  return ((x + 1) * (x + 1) + y * y) < 0.0625;
+}
+
+// One thread's share of the batch. The orbit of a sample is the same for
+// every color, only where it is cut off differs, so each sample is iterated
+// once to the largest max iterations: a color whose max is above the escape
+// iteration gets the trail. The conjugate sample's trail is the mirror image
+// (z^2 + c is symmetric), so both are plotted from one orbit.
+static void sample_hits(unsigned long long samples, unsigned long long seed,
+                        unsigned int w, unsigned int h, double minx,
+                        double maxx, double miny, double maxy,
+                        const unsigned int *color_max,
+                        vector<atomic<unsigned long long>> *hits,
+                        cuda_kernel_stats &thread_stats) {
+  cuda_kernel_stats stats{0, 0, 0, 0};  // thread_stats entries share lines
+  const unsigned int L = CPU_LANES;
+  const unsigned int iters =
+      max(color_max[0], max(color_max[1], color_max[2]));
+  mt19937_64 gen(seed);
+  uniform_real_distribution<double> ux(minx, maxx);
+  uniform_real_distribution<double> uy(miny, maxy);
+  vector<double> trail_r((size_t)L * iters);
+  vector<double> trail_i((size_t)L * iters);
+  const double sx = w / (maxx - minx);
+  const double sy = h / (maxy - miny);
+
+  auto plot = [&](vector<atomic<unsigned long long>> &hit, double x,
+                  double y) {
+    if ((x <= maxx) && (x >= minx) && (y <= maxy) && (y >= miny)) {
+      unsigned int px = (unsigned int)((x - minx) * sx);
+      unsigned int py = (unsigned int)((y - miny) * sy);
+      if ((px < w) && (py < h))
+        hit[px + (size_t)py * w].fetch_add(1, memory_order_relaxed);
+    }
+  };
+
+  unsigned long long done = 0;
+  while (done < samples) {
+    double cr[L], ci[L], zr[L], zi[L];
+    unsigned int escaped[L];
+    bool live[L];
+    unsigned int n = 0;
+    while ((n < L) && (done < samples)) {
+      double x = ux(gen);
+      double y = uy(gen);
+      ++done;
+      stats.total++;
+      if (skipInSet_cpu(x, y)) {
+        stats.rejected++;
+        continue;
+      }
+      cr[n] = x;
+      ci[n] = y;
+      ++n;
+    }
+    unsigned int left = n;
+    for (unsigned int k = 0; k < L; ++k) {
+      if (k >= n) {
+        cr[k] = 0;
+        ci[k] = 0;
+      }
+      zr[k] = 0;
+      zi[k] = 0;
+      escaped[k] = iters;
+      live[k] = (k < n);
+    }
+
+    for (unsigned int it = 0; (it < iters) && (left > 0); ++it) {
+      for (unsigned int k = 0; k < L; ++k) {
+        double r = zr[k] * zr[k] - zi[k] * zi[k] + cr[k];
+        zi[k] = 2 * zr[k] * zi[k] + ci[k];
+        zr[k] = r;
+      }
+      for (unsigned int k = 0; k < L; ++k) {
+        if (!live[k]) continue;
+        trail_r[(size_t)k * iters + it] = zr[k];
+        trail_i[(size_t)k * iters + it] = zi[k];
+        if (zr[k] * zr[k] + zi[k] * zi[k] >= 4.0) {
+          escaped[k] = it + 1;
+          live[k] = false;
+          left--;
+        }
+      }
+    }
+
+    for (unsigned int k = 0; k < n; ++k) {
+      for (unsigned int c = 0; c < 3; ++c) {
+        if (escaped[k] >= color_max[c]) {
+          stats.in_set++;
+          continue;
+        }
+        stats.escaped_set += 2;  // the sample and its conjugate
+        const double *tr = &trail_r[(size_t)k * iters];
+        const double *ti = &trail_i[(size_t)k * iters];
+        for (unsigned int i = 0; i < escaped[k]; ++i) {
+          plot(hits[c], tr[i], ti[i]);
+          plot(hits[c], tr[i], -ti[i]);
+        }
+      }
+    }
+  }
+  thread_stats = stats;
+}
+
+int cuda_generate_buddhabrot_hits(
+    unsigned int w, unsigned int h, SupportedFractal &frac, SampleStats &stats,
+    vector<vector<long long unsigned int>> &redHits,
+    vector<vector<long long unsigned int>> &greenHits,
+    vector<vector<long long unsigned int>> &blueHits) {
+  // 1D hits shared by the threads, collisions are rare so relaxed atomics
+  // cost little
+  vector<atomic<unsigned long long>> hits[3];
+  for (auto &hit : hits) hit = vector<atomic<unsigned long long>>((size_t)w * h);
+  const unsigned int color_max[3] = {frac.current_max_iters[0],
+                                     frac.current_max_iters[1],
+                                     frac.current_max_iters[2]};
+
+  unsigned int threads = max(1u, thread::hardware_concurrency());
+  vector<cuda_kernel_stats> thread_stats(threads, cuda_kernel_stats{0, 0, 0, 0});
+  random_device rd;
+  unsigned long long seed =
+      ((unsigned long long)rd() << 32) ^
+      (unsigned long long)chrono::steady_clock::now().time_since_epoch().count();
+  vector<thread> pool;
+  for (unsigned int t = 0; t < threads; ++t) {
+    unsigned long long share = CPU_BATCH_SAMPLES / threads +
+                               (t < CPU_BATCH_SAMPLES % threads ? 1 : 0);
+    pool.emplace_back(sample_hits, share, seed + 0x9e3779b97f4a7c15ull * t, w,
+                      h, frac.xMinMax[0], frac.xMinMax[1], frac.yMinMax[0],
+                      frac.yMinMax[1], color_max, hits, ref(thread_stats[t]));
+  }
+  for (auto &t : pool) t.join();
+
+  stats.total = 0;
+  stats.rejected = 0;
+  stats.in_set = 0;
+  stats.escaped_set = 0;
+  for (auto &s : thread_stats) {
+    stats.total += s.total;
+    stats.rejected += s.rejected;
+    stats.in_set += s.in_set;
+    stats.escaped_set += s.escaped_set;
+  }
+
+  // same [x][y] layout the cuda version returns
+  vector<vector<long long unsigned int>> *out[3] = {&redHits, &greenHits,
+                                                    &blueHits};
+  for (unsigned int c = 0; c < 3; ++c) {
+    out[c]->resize(w);
+    for (auto &v : *out[c]) v.resize(h);
+    for (unsigned int i = 0; i < w; ++i)
+      for (unsigned int j = 0; j < h; ++j)
+        (*out[c])[i][j] = hits[c][i + (size_t)j * w].load(memory_order_relaxed);
+  }
+  return 0;
+}
@@ -89,6 +89,8 @@ void cudaPrintDeviceProperties(cudaDeviceProp & devProp) {
     printf("Kernel execution timeout:      %s\n",  (devProp.kernelExecTimeoutEnabled ? "Yes" : "No"));
 }
 
+const char *buddha_backend(void) { return "cuda"; }
+
 int cuda_info() {
   int nDevices = 0;
   cudaGetDeviceCount(&nDevices);
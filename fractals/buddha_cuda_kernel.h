@@ -2,7 +2,12 @@
 #include <vector>
 #include "fractals.h"
 
-//if it returns zero, you have no cuda devices
+//"cuda" (buddha_cuda_kernel.cu) or "cpu" (buddha_cpu_kernel.cpp, built when
+//there is no nvcc: same API, the hits come from all the cpu threads)
+const char *buddha_backend(void);
+
+//if it returns zero, you have no cuda devices (the cpu backend reports one
+//only when built with BUDDHA_CPU_BATCH)
 int cuda_info(void);
 
 //basic test program
@@ -0,0 +1,48 @@
+#pragma once
+// Front end side of the fractal engine: the texture and sprite a
+// FractalModel is shown with. The model only keeps its RGBA frame buffers,
+// upload() copies what changed in them since the last frame to the texture
+// (so the headless tools need no window or gl).
+
+#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <optional>
+
+#include "fractal_engine.h"
+
+class FractalCanvas : public sf::Drawable, public sf::Transformable {
+ public:
+  FractalCanvas(unsigned int view_width, unsigned int view_height) {
+    if (!texture.resize(sf::Vector2u(view_width, view_height)))
+      std::cout << "could not create " << view_width << "x" << view_height
+                << " fractal texture" << std::endl;
+    sprite.emplace(texture);
+  }
+
+  // send the rows the model changed since last time, once per frame after
+  // FractalModel::update
+  void upload(FractalModel &model) {
+    const unsigned int width = texture.getSize().x;
+    model.takeFrameChanges([&](const std::uint8_t *rgba, unsigned int ys,
+                               unsigned int ye) {
+      texture.update(rgba, sf::Vector2u(width, ye - ys), sf::Vector2u(0, ys));
+    });
+  }
+
+ private:
+  virtual void draw(sf::RenderTarget &target, sf::RenderStates states) const {
+    // apply the transform
+    states.transform *= getTransform();
+
+    // our particles don't use a texture
+    states.texture = NULL;
+
+    // draw the image (just one for now - could do multiple fractals blended)
+    if (sprite.has_value()) {
+      target.draw(*sprite, states);
+    }
+  }
+
+  sf::Texture texture;
+  std::optional<sf::Sprite> sprite;
+};
@@ -0,0 +1,5762 @@
+#pragma once
+// Fractal engine: kernels, FractalModel, worker scheduler, keys, tile cache,
+// benchmark and animation. Everything but the gui, so the tgui front ends
+// (fractals_with_gui_cuda.cpp, fractals_with_gui.cpp) and the headless tools
+// (fractals_headless.cpp) share one copy. Header only: definitions are
+// inline so any number of translation units can include it. Only sf::Image
+// is used from sfml, the front ends draw the model with a FractalCanvas
+// (fractal_canvas.h).
+
+#include <math.h>
+#include <signal.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <io.h>
+#endif
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
+
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/System/Time.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "buddha_cuda_kernel.h"
+#include "fractals.h"
+#include "tinycolormap.hpp"
+
+namespace fs = std::filesystem;
+
+inline void signal_callback_handler(int signum) {
+  std::cout << "Caught signal " << signum << std::endl;
+  // Terminate program
+  exit(signum);
+}
+
+// For really good pictures
+const int IMAGE_WIDTH = 2560;
+const int IMAGE_HEIGHT = 1440;
+
+// const int IMAGE_WIDTH = 1600;
+// const int IMAGE_HEIGHT = 1200;
+
+// The zoom and rotation and panning and color of the fractal
+
+enum class ColoringAlgo {
+  MULTICYCLE,
+  SMOOTH,
+  USE_IMAGE,
+  SHADOW_MAP,
+  DISTANCE_ESTIMATE,
+  HISTOGRAM
+};
+
+enum class ColorCycle { CC8, CC16, CC32, CC64, CC128, CC256 };
+
+enum class InteriorColoringAlgo {
+  SOLID,
+  MULTICYCLE,
+  USE_IMAGE,
+  TRIG,
+  TRIG2,
+  DIST,
+  DIST2,
+  TEMP
+};
+#define LAST_INTERIOR_COLOR_ALGO ((unsigned int)InteriorColoringAlgo::DISTANCE)
+inline unsigned int interior_color_adjust = 0;
+
+// Buddhabrot hit count -> channel brightness
+enum class ToneMap { SQRT, LINEAR, LOG, GAMMA, ASINH, HISTOGRAM };
+
+// std::is_trivially_copyable
+class ReferenceFrame {
+ public:
+  // x-y rotation angle [future]
+  float theta;
+
+  // View
+  //
+  double xstart;          // in fractal coordinates
+  double ystart;          // in fractal coordinates
+  double xstart_lo = 0;   // low words of xstart, ystart as double-doubles
+  double ystart_lo = 0;   // for zooms past double precision
+  double xdelta;          // delta per pixel in fractal coordinates
+  double ydelta;          // delta per pixel in fractal coordinates
+  double current_width;   // in pixels
+  double current_height;  // in pixels
+
+  // Zoom Level
+  double displayed_zoom;
+  double requested_zoom;
+
+  // zoom crop area
+  bool show_selection;
+
+  // Color Palletes
+  ColoringAlgo color_algo;
+  int color_cycle_size;
+
+  tinycolormap::ColormapType palette;
+  bool reflect_palette;
+  double palette_offset = 0;  // color cycling, fraction of the palette
+
+  // Escape Image coloring
+  unsigned int escape_image_w;
+  unsigned int escape_image_h;
+  bool image_loaded;
+
+  // normal maps
+  double light_pos_r;
+  double light_pos_i;
+  double light_angle;
+  double light_height;
+
+  // Random Sample faster but less exact rendering
+  bool random_sample = false;
+
+  // Original total Pixels
+  double original_width;
+  double original_height;
+
+  ReferenceFrame(float _thetaxy, double _zoom)
+      : theta{_thetaxy}, displayed_zoom{_zoom} {};
+
+};  // ReferenceFrame
+
+// Non Serializable part of Fractal description thats too big to store in a key
+class NSReferenceFrame {
+ public:
+  std::vector<std::string> color_cycle_size_names{
+      std::string("8"),  std::string("16"),  std::string("32"),
+      std::string("64"), std::string("128"), std::string("256")};
+  std::vector<std::string> color_names{std::string("Parula"),
+                                       std::string("Heat"),
+                                       std::string("Jet"),
+                                       std::string("Hot"),
+                                       std::string("Turbo"),
+                                       std::string("Gray"),
+                                       std::string("Magma"),
+                                       std::string("Inferno"),
+                                       std::string("Plasma"),
+                                       std::string("Viridis"),
+                                       std::string("Cividis"),
+                                       std::string("Github"),
+                                       std::string("Cubehelix"),
+                                       std::string("UF16")};
+  sf::Image escape_image;
+
+  // Buddhabrot tone mapping - only changes how the accumulated hits are
+  // displayed so it can be switched without resetting them
+  std::vector<std::string> tone_map_names{
+      std::string("SQRT"),  std::string("LINEAR"), std::string("LOG"),
+      std::string("GAMMA"), std::string("ASINH"),  std::string("HISTOGRAM")};
+  ToneMap tone_map = ToneMap::SQRT;
+  double tone_gamma = 3.0;    // GAMMA: (hits/max)^(1/gamma)
+  double tone_asinh = 100.0;  // ASINH: asinh(k*hits/max)/asinh(k)
+};  // NSReferenceFrame
+
+inline ReferenceFrame R(0, 1.0);
+inline NSReferenceFrame NSR;  // non serializable
+
+
+class ReferenceFrameInt {
+ public:
+  // Color Palletes
+  InteriorColoringAlgo color_algo;
+  int color_cycle_size;
+
+  tinycolormap::ColormapType palette;
+  bool reflect_palette;
+  ReferenceFrameInt(InteriorColoringAlgo _ca, int _ccs, tinycolormap::ColormapType _p, bool _rp)
+      : color_algo{_ca},
+        color_cycle_size{_ccs},
+        palette{_p},
+        reflect_palette{_rp} {};
+};  // ReferenceFrameInt
+
+inline ReferenceFrameInt RI(InteriorColoringAlgo::SOLID, 256,
+                            tinycolormap::ColormapType::UF16, false);
+
+
+// Submodel for different fractals
+// #include "fractals.h" SupportedFractal (shared with cuda)
+
+// struct SupportedFractal {
+//   std::string name;
+//   bool cuda_mode;
+//   bool probabalistic; //i.e. like buddha - affects thread model
+//   bool julia;
+//   bool anti;
+//   std::vector<double> xMinMax;  // default x min max
+//   std::vector<double> yMinMax;  // default min max
+//   std::vector<unsigned int> current_max_iters;
+//   std::vector<unsigned int> default_max_iters;
+//   double current_power;
+//   double default_power;
+//   std::complex<double> current_zconst;
+//   std::complex<double> default_zconst;
+//   double current_escape_r;
+//   double default_escape_r;
+//   FractalFormula formula;  // escape time kernel
+//   std::vector<double> sample_window;
+//   std::vector<std::complex<double>> current_poly;
+//   std::vector<std::complex<double>> default_poly;
+// };
+
+inline std::vector<SupportedFractal> FRAC = {
+    {std::string("Mandelbrot_300"),
+     false,
+     false,
+     false,  // julia
+     false,
+     {-2.50, 1.5},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string("Mandelbrot_1000"),
+     false,
+     false,
+     false,  // julia
+     false,
+     {-2.5, 1.5},
+     {-1.4, 1.4},
+     {1000, 0, 0},
+     {1000, 0, 0},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string("Julia"),
+     false,
+     false,
+     true,  // julia
+     false,
+     {-2.2, 2.2},
+     {-1.2, 1.2},
+     {300, 0, 0},
+     {300, 0, 0},
+     2,
+     2,
+     std::complex<double>{-0.79, 0.15},
+     std::complex<double>{-0.79, 0.15},
+     2,
+     2},
+    {std::string("Spiral_Septagon"),
+     false,
+     false,
+     false,
+     false,
+     {-2.2, 2.2},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     7,
+     7,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::SPIRAL_SEPTAGON},
+    {std::string("Buddhabrot"),  // not going to be zoomable and pannable
+     true,
+     true,
+     false,
+     false,
+     {-2.2, 1.0},
+     {-1.2, 1.2},
+     {10000, 1000, 100},
+     {10000, 1000, 100},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string("Buddhabrot_BW"),  // not going to be zoomable and pannable
+     true,
+     true,
+     false,
+     false,
+     {-2.2, 1.0},
+     {-1.2, 1.2},
+     {10000, 10000, 10000},
+     {10000, 10000, 10000},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string(
+         "Buddhabrot_General"),  // not going to be zoomable and pannable
+     false,
+     true,
+     false,
+     false,
+     {-2.2, 1.0},
+     {-1.2, 1.2},
+     {10000, 1000, 100},
+     {10000, 1000, 100},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string(
+         "Buddhabrot_General_Julia"),  // not going to be zoomable and pannable
+     false,
+     true,
+     true,  // julia
+     false,
+     {-2.2, 1.0},
+     {-1.2, 1.2},
+     {10000, 1000, 100},
+     {10000, 1000, 100},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string(
+         "Anti_Buddhabrot_General"),  // not going to be zoomable and pannable
+     false,
+     true,
+     false,
+     true,  // anti
+     {-2.2, 1.0},
+     {-1.2, 1.2},
+     {10000, 10000, 10000},
+     {10000, 10000, 10000},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2},
+    {std::string(
+         "Anti_Buddhabrot_Small"),  // not going to be zoomable and pannable
+     false,
+     true,
+     false,
+     true,  // anti
+     {-1.5, .25},
+     {-1.0, .25},
+     {10000, 10000, 10000},
+     {10000, 10000, 10000},
+     2,
+     2,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::MANDELBROT,
+     {-2.2, 1.0, -1.2, 1.2}},  // sample all orbits
+    {std::string("Nova_z6+z3-1"),
+     false,
+     false,
+     false,
+     false,
+     {-2.5, 1.5},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     6,
+     6,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::NOVA_Z6},
+    {std::string("Newton_z6+z3-1"),
+     false,
+     false,
+     false,
+     false,
+     {-2.5, 1.5},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     6,
+     6,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::NEWTON_Z6},
+    {std::string("Newton_Polynomial"),
+     false,
+     false,
+     false,
+     false,
+     {-2.5, 1.5},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     3,
+     3,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::NEWTON_POLY,
+     {},
+     {1, 0, 0, -1},  // z^3 - 1
+     {1, 0, 0, -1}},
+    {std::string("Nova_Polynomial"),
+     false,
+     false,
+     false,
+     false,
+     {-2.5, 1.5},
+     {-1.4, 1.4},
+     {300, 0, 0},
+     {300, 0, 0},
+     3,
+     3,
+     std::complex<double>{0, 0},
+     std::complex<double>{0, 0},
+     2,
+     2,
+     FractalFormula::NOVA_POLY,
+     {},
+     {1, 0, 0, -1},
+     {1, 0, 0, -1}},
+};
+
+
+// std::filesystem::path::preferred_separator
+//  / works on windows also
+inline std::string separator{"/"};
+
+const int FRACTAL_VERSION{2};
+
+//directory_name
+inline std::string key_version =
+    std::string{"fractal_key_version_"} + std::to_string(FRACTAL_VERSION);
+// raw SavedFractal keys, still read and migrated on startup
+inline std::string legacy_key_version = std::string{"fractal_key_version_1"};
+
+#ifdef _WINDOWS
+inline std::string keys_location = std::string{".."} + separator +
+                                   std::string{".."} + separator +
+                                   std::string{".."} + separator;
+#else
+inline std::string keys_location = std::string { "" };
+#endif
+
+
+// User polynomials (Newton_Polynomial, Nova_Polynomial): coefficients,
+// highest power first, as "1 0 0 -1" or with complex ones "(1,2) 0 -1"
+const unsigned int POLY_MAX_DEGREE = 16;
+
+// fixed size copy for SavedFractal
+struct PolyCoeffs {
+  unsigned int count = 0;
+  std::complex<double> c[POLY_MAX_DEGREE + 1];
+};
+
+inline PolyCoeffs to_poly_coeffs(
+    const std::vector<std::complex<double>> &poly) {
+  PolyCoeffs pc;
+  pc.count = (unsigned int)std::min<size_t>(poly.size(), POLY_MAX_DEGREE + 1);
+  for (unsigned int k = 0; k < pc.count; ++k) pc.c[k] = poly[k];
+  return pc;
+}
+
+inline std::vector<std::complex<double>> from_poly_coeffs(
+    const PolyCoeffs &pc) {
+  return std::vector<std::complex<double>>(pc.c, pc.c + pc.count);
+}
+
+// false (poly unchanged) unless text is 2 to POLY_MAX_DEGREE + 1 numbers
+inline bool parse_poly(const std::string &text,
+                       std::vector<std::complex<double>> &poly) {
+  std::istringstream in(text);
+  std::vector<std::complex<double>> read;
+  std::complex<double> c;
+  while (in >> c) read.push_back(c);
+  if (!in.eof() || (read.size() < 2) || (read.size() > POLY_MAX_DEGREE + 1))
+    return false;
+  poly = read;
+  return true;
+}
+
+inline std::string poly_to_string(
+    const std::vector<std::complex<double>> &poly) {
+  std::ostringstream out;
+  out.precision(17);
+  for (size_t k = 0; k < poly.size(); ++k) {
+    if (k != 0) out << " ";
+    if (poly[k].imag() == 0)
+      out << poly[k].real();
+    else
+      out << poly[k];
+  }
+  return out.str();
+}
+
+// Should be trivially_copyable/serializable
+class SavedFractal {
+ public:
+  int version = FRACTAL_VERSION;
+  // p_model->current_fractal
+  // FRAC[p_model->current_fractal].current_power
+  // FRAC[p_model->current_fractal].current_max_iters[0]
+  // FRAC[p_model->current_fractal].current_zconst
+  int valid;
+  unsigned int current_fractal;
+  unsigned int current_max_iters[3];
+  double current_power;
+  std::complex<double> current_zconst;
+  double current_escape_r;
+  PolyCoeffs poly;
+
+  ReferenceFrame RF;
+  // but not NSR
+
+  SavedFractal(float _thetaxy, double _zoom) : valid{0}, RF{_thetaxy, _zoom} {};
+};
+
+// Key files (version 2+): "FKEY", u16 format version, then tagged records of
+// u16 field id, u16 payload length and the little endian payload, ending with
+// KeyField::END. Readers skip ids they dont know and keep the current value
+// for missing ones, so fields can come and go without breaking old keys or
+// the batch tools (make_fractal_movies.py has the same table).
+// Never renumber: only append ids.
+enum class KeyField : std::uint16_t {
+  END = 0,
+  // fractal
+  FRACTAL_INDEX = 1,  // FRAC index, FRACTAL_NAME wins if it is found
+  FRACTAL_NAME = 2,
+  MAX_ITERS_0 = 3,
+  MAX_ITERS_1 = 4,
+  MAX_ITERS_2 = 5,
+  POWER = 6,
+  ZCONST_RE = 7,
+  ZCONST_IM = 8,
+  ESCAPE_R = 9,
+  POLY = 10,  // text, see parse_poly
+  // ReferenceFrame
+  THETA = 20,
+  XSTART = 21,
+  YSTART = 22,
+  XDELTA = 23,
+  YDELTA = 24,
+  CURRENT_WIDTH = 25,
+  CURRENT_HEIGHT = 26,
+  DISPLAYED_ZOOM = 27,
+  REQUESTED_ZOOM = 28,
+  COLOR_ALGO = 29,
+  COLOR_CYCLE_SIZE = 30,
+  PALETTE = 31,
+  REFLECT_PALETTE = 32,
+  ESCAPE_IMAGE_W = 33,
+  ESCAPE_IMAGE_H = 34,
+  IMAGE_LOADED = 35,
+  LIGHT_POS_R = 36,
+  LIGHT_POS_I = 37,
+  LIGHT_ANGLE = 38,
+  LIGHT_HEIGHT = 39,
+  RANDOM_SAMPLE = 40,
+  ORIGINAL_WIDTH = 41,
+  ORIGINAL_HEIGHT = 42,
+  PALETTE_OFFSET = 43,
+  XSTART_LO = 44,
+  YSTART_LO = 45,
+};
+
+const char KEY_MAGIC[4] = {'F', 'K', 'E', 'Y'};
+
+class KeyWriter {
+ public:
+  KeyWriter() {
+    bytes.append(KEY_MAGIC, 4);
+    le(FRACTAL_VERSION, 2);
+  }
+  void u32(KeyField id, std::uint32_t v) {
+    field(id, 4);
+    le(v, 4);
+  }
+  void i32(KeyField id, std::int32_t v) { u32(id, (std::uint32_t)v); }
+  void f64(KeyField id, double v) {
+    std::uint64_t b;
+    memcpy(&b, &v, sizeof(b));
+    field(id, 8);
+    le(b, 8);
+  }
+  void flag(KeyField id, bool v) {
+    field(id, 1);
+    le(v ? 1 : 0, 1);
+  }
+  void str(KeyField id, const std::string &v) {
+    field(id, (std::uint16_t)std::min<size_t>(v.size(), 0xffff));
+    bytes.append(v, 0, std::min<size_t>(v.size(), 0xffff));
+  }
+  // append END, returns the key bytes
+  const std::string &finish() {
+    le((std::uint16_t)KeyField::END, 2);
+    le(0, 2);
+    return bytes;
+  }
+
+ private:
+  void field(KeyField id, std::uint16_t len) {
+    le((std::uint16_t)id, 2);
+    le(len, 2);
+  }
+  void le(std::uint64_t v, int n) {
+    for (int i = 0; i < n; ++i) bytes.push_back((char)((v >> (8 * i)) & 0xff));
+  }
+  std::string bytes;
+};
+
+class KeyReader {
+ public:
+  // false if bytes is not a tagged key or is truncated
+  bool parse(const std::string &bytes) {
+    if ((bytes.size() < 6) || (bytes.compare(0, 4, KEY_MAGIC, 4) != 0))
+      return false;
+    version = (unsigned int)le(bytes, 4, 2);
+    size_t at = 6;
+    while (at + 4 <= bytes.size()) {
+      std::uint16_t id = (std::uint16_t)le(bytes, at, 2);
+      std::uint16_t len = (std::uint16_t)le(bytes, at + 2, 2);
+      at += 4;
+      if (id == (std::uint16_t)KeyField::END) return true;
+      if (at + len > bytes.size()) return false;
+      fields[id] = bytes.substr(at, len);  // unknown ids are just kept
+      at += len;
+    }
+    return false;
+  }
+
+  bool has(KeyField id) const { return fields.count((std::uint16_t)id) != 0; }
+  std::uint32_t u32(KeyField id, std::uint32_t def) const {
+    const std::string *p = get(id, 4);
+    return p ? (std::uint32_t)le(*p, 0, 4) : def;
+  }
+  std::int32_t i32(KeyField id, std::int32_t def) const {
+    return (std::int32_t)u32(id, (std::uint32_t)def);
+  }
+  double f64(KeyField id, double def) const {
+    const std::string *p = get(id, 8);
+    if (p == nullptr) return def;
+    std::uint64_t b = le(*p, 0, 8);
+    double v;
+    memcpy(&v, &b, sizeof(v));
+    return v;
+  }
+  bool flag(KeyField id, bool def) const {
+    const std::string *p = get(id, 1);
+    return p ? ((*p)[0] != 0) : def;
+  }
+  std::string str(KeyField id, const std::string &def) const {
+    auto f = fields.find((std::uint16_t)id);
+    return (f == fields.end()) ? def : f->second;
+  }
+
+  unsigned int version = 0;
+
+ private:
+  // payload of id if it has the expected size
+  const std::string *get(KeyField id, size_t size) const {
+    auto f = fields.find((std::uint16_t)id);
+    if ((f == fields.end()) || (f->second.size() != size)) return nullptr;
+    return &f->second;
+  }
+  static std::uint64_t le(const std::string &b, size_t at, int n) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < n; ++i)
+      v |= (std::uint64_t)(unsigned char)b[at + i] << (8 * i);
+    return v;
+  }
+  std::unordered_map<std::uint16_t, std::string> fields;
+};
+
+inline std::string encode_key(const SavedFractal &sf) {
+  KeyWriter w;
+  w.u32(KeyField::FRACTAL_INDEX, sf.current_fractal);
+  if (sf.current_fractal < FRAC.size())
+    w.str(KeyField::FRACTAL_NAME, FRAC[sf.current_fractal].name);
+  w.u32(KeyField::MAX_ITERS_0, sf.current_max_iters[0]);
+  w.u32(KeyField::MAX_ITERS_1, sf.current_max_iters[1]);
+  w.u32(KeyField::MAX_ITERS_2, sf.current_max_iters[2]);
+  w.f64(KeyField::POWER, sf.current_power);
+  w.f64(KeyField::ZCONST_RE, sf.current_zconst.real());
+  w.f64(KeyField::ZCONST_IM, sf.current_zconst.imag());
+  w.f64(KeyField::ESCAPE_R, sf.current_escape_r);
+  if (sf.poly.count != 0)
+    w.str(KeyField::POLY, poly_to_string(from_poly_coeffs(sf.poly)));
+
+  const ReferenceFrame &rf = sf.RF;
+  w.f64(KeyField::THETA, rf.theta);
+  w.f64(KeyField::XSTART, rf.xstart);
+  w.f64(KeyField::YSTART, rf.ystart);
+  w.f64(KeyField::XDELTA, rf.xdelta);
+  w.f64(KeyField::YDELTA, rf.ydelta);
+  w.f64(KeyField::CURRENT_WIDTH, rf.current_width);
+  w.f64(KeyField::CURRENT_HEIGHT, rf.current_height);
+  w.f64(KeyField::DISPLAYED_ZOOM, rf.displayed_zoom);
+  w.f64(KeyField::REQUESTED_ZOOM, rf.requested_zoom);
+  w.u32(KeyField::COLOR_ALGO, (std::uint32_t)rf.color_algo);
+  w.i32(KeyField::COLOR_CYCLE_SIZE, rf.color_cycle_size);
+  w.u32(KeyField::PALETTE, (std::uint32_t)rf.palette);
+  w.flag(KeyField::REFLECT_PALETTE, rf.reflect_palette);
+  w.u32(KeyField::ESCAPE_IMAGE_W, rf.escape_image_w);
+  w.u32(KeyField::ESCAPE_IMAGE_H, rf.escape_image_h);
+  w.flag(KeyField::IMAGE_LOADED, rf.image_loaded);
+  w.f64(KeyField::LIGHT_POS_R, rf.light_pos_r);
+  w.f64(KeyField::LIGHT_POS_I, rf.light_pos_i);
+  w.f64(KeyField::LIGHT_ANGLE, rf.light_angle);
+  w.f64(KeyField::LIGHT_HEIGHT, rf.light_height);
+  w.flag(KeyField::RANDOM_SAMPLE, rf.random_sample);
+  w.f64(KeyField::ORIGINAL_WIDTH, rf.original_width);
+  w.f64(KeyField::ORIGINAL_HEIGHT, rf.original_height);
+  w.f64(KeyField::PALETTE_OFFSET, rf.palette_offset);
+  w.f64(KeyField::XSTART_LO, rf.xstart_lo);
+  w.f64(KeyField::YSTART_LO, rf.ystart_lo);
+  return w.finish();
+}
+
+// Fields missing from the key keep the values already in sf
+inline bool decode_key(const std::string &bytes, SavedFractal &sf) {
+  KeyReader r;
+  if (!r.parse(bytes)) return false;
+
+  unsigned int ix = r.u32(KeyField::FRACTAL_INDEX, sf.current_fractal);
+  std::string name = r.str(KeyField::FRACTAL_NAME, "");
+  for (unsigned int f = 0; f < FRAC.size(); ++f)
+    if (FRAC[f].name == name) ix = f;
+  if (ix >= FRAC.size()) return false;
+  sf.version = (int)r.version;
+  sf.valid = 1;
+  sf.current_fractal = ix;
+  sf.current_max_iters[0] = r.u32(KeyField::MAX_ITERS_0, sf.current_max_iters[0]);
+  sf.current_max_iters[1] = r.u32(KeyField::MAX_ITERS_1, sf.current_max_iters[1]);
+  sf.current_max_iters[2] = r.u32(KeyField::MAX_ITERS_2, sf.current_max_iters[2]);
+  sf.current_power = r.f64(KeyField::POWER, sf.current_power);
+  sf.current_zconst = std::complex<double>(
+      r.f64(KeyField::ZCONST_RE, sf.current_zconst.real()),
+      r.f64(KeyField::ZCONST_IM, sf.current_zconst.imag()));
+  sf.current_escape_r = r.f64(KeyField::ESCAPE_R, sf.current_escape_r);
+  std::vector<std::complex<double>> poly;
+  if (parse_poly(r.str(KeyField::POLY, ""), poly))
+    sf.poly = to_poly_coeffs(poly);
+
+  ReferenceFrame &rf = sf.RF;
+  rf.theta = (float)r.f64(KeyField::THETA, rf.theta);
+  rf.xstart = r.f64(KeyField::XSTART, rf.xstart);
+  rf.ystart = r.f64(KeyField::YSTART, rf.ystart);
+  rf.xdelta = r.f64(KeyField::XDELTA, rf.xdelta);
+  rf.ydelta = r.f64(KeyField::YDELTA, rf.ydelta);
+  rf.current_width = r.f64(KeyField::CURRENT_WIDTH, rf.current_width);
+  rf.current_height = r.f64(KeyField::CURRENT_HEIGHT, rf.current_height);
+  rf.displayed_zoom = r.f64(KeyField::DISPLAYED_ZOOM, rf.displayed_zoom);
+  rf.requested_zoom = r.f64(KeyField::REQUESTED_ZOOM, rf.requested_zoom);
+  std::uint32_t algo = r.u32(KeyField::COLOR_ALGO, (std::uint32_t)rf.color_algo);
+  if (algo <= (std::uint32_t)ColoringAlgo::HISTOGRAM)
+    rf.color_algo = static_cast<ColoringAlgo>(algo);
+  rf.color_cycle_size = r.i32(KeyField::COLOR_CYCLE_SIZE, rf.color_cycle_size);
+  std::uint32_t palette = r.u32(KeyField::PALETTE, (std::uint32_t)rf.palette);
+  if (palette < NSR.color_names.size())
+    rf.palette = static_cast<tinycolormap::ColormapType>(palette);
+  rf.reflect_palette = r.flag(KeyField::REFLECT_PALETTE, rf.reflect_palette);
+  rf.escape_image_w = r.u32(KeyField::ESCAPE_IMAGE_W, rf.escape_image_w);
+  rf.escape_image_h = r.u32(KeyField::ESCAPE_IMAGE_H, rf.escape_image_h);
+  rf.image_loaded = r.flag(KeyField::IMAGE_LOADED, rf.image_loaded);
+  rf.light_pos_r = r.f64(KeyField::LIGHT_POS_R, rf.light_pos_r);
+  rf.light_pos_i = r.f64(KeyField::LIGHT_POS_I, rf.light_pos_i);
+  rf.light_angle = r.f64(KeyField::LIGHT_ANGLE, rf.light_angle);
+  rf.light_height = r.f64(KeyField::LIGHT_HEIGHT, rf.light_height);
+  rf.random_sample = r.flag(KeyField::RANDOM_SAMPLE, rf.random_sample);
+  rf.original_width = r.f64(KeyField::ORIGINAL_WIDTH, rf.original_width);
+  rf.original_height = r.f64(KeyField::ORIGINAL_HEIGHT, rf.original_height);
+  rf.palette_offset = r.f64(KeyField::PALETTE_OFFSET, 0.0);
+  rf.xstart_lo = r.f64(KeyField::XSTART_LO, 0.0);
+  rf.ystart_lo = r.f64(KeyField::YSTART_LO, 0.0);
+  rf.show_selection = false;
+  return true;
+}
+
+// Read a tagged key, or a version 1 key (the raw SavedFractal bytes).
+// sf should hold the current state: the tagged fields override it.
+// SavedFractal as version 1 keys dumped it, frozen so SavedFractal and
+// ReferenceFrame can keep growing
+struct SavedFractalV1 {
+  int version;
+  int valid;
+  unsigned int current_fractal;
+  unsigned int current_max_iters[3];
+  double current_power;
+  std::complex<double> current_zconst;
+  double current_escape_r;
+  struct {
+    float theta;
+    double xstart;
+    double ystart;
+    double xdelta;
+    double ydelta;
+    double current_width;
+    double current_height;
+    double displayed_zoom;
+    double requested_zoom;
+    bool show_selection;
+    ColoringAlgo color_algo;
+    int color_cycle_size;
+    tinycolormap::ColormapType palette;
+    bool reflect_palette;
+    unsigned int escape_image_w;
+    unsigned int escape_image_h;
+    bool image_loaded;
+    double light_pos_r;
+    double light_pos_i;
+    double light_angle;
+    double light_height;
+    bool random_sample;
+    double original_width;
+    double original_height;
+  } RF;
+};
+
+inline bool read_key_file(const std::string &filename, SavedFractal &sf) {
+  std::ifstream key(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!key) return false;
+  std::string bytes((std::istreambuf_iterator<char>(key)),
+                    std::istreambuf_iterator<char>());
+  if (decode_key(bytes, sf)) return true;
+
+  if (bytes.size() != sizeof(SavedFractalV1)) return false;
+  SavedFractalV1 v1;
+  memcpy(reinterpret_cast<char *>(&v1), bytes.data(), bytes.size());
+  if ((v1.version != 1) || (v1.current_fractal >= FRAC.size())) return false;
+  sf.valid = v1.valid;
+  sf.current_fractal = v1.current_fractal;
+  for (int k = 0; k < 3; ++k) sf.current_max_iters[k] = v1.current_max_iters[k];
+  sf.current_power = v1.current_power;
+  sf.current_zconst = v1.current_zconst;
+  sf.current_escape_r = v1.current_escape_r;
+  ReferenceFrame &rf = sf.RF;
+  rf.theta = v1.RF.theta;
+  rf.xstart = v1.RF.xstart;
+  rf.ystart = v1.RF.ystart;
+  rf.xdelta = v1.RF.xdelta;
+  rf.ydelta = v1.RF.ydelta;
+  rf.current_width = v1.RF.current_width;
+  rf.current_height = v1.RF.current_height;
+  rf.displayed_zoom = v1.RF.displayed_zoom;
+  rf.requested_zoom = v1.RF.requested_zoom;
+  rf.show_selection = false;
+  rf.color_algo = v1.RF.color_algo;
+  rf.color_cycle_size = v1.RF.color_cycle_size;
+  rf.palette = v1.RF.palette;
+  rf.reflect_palette = v1.RF.reflect_palette;
+  rf.escape_image_w = v1.RF.escape_image_w;
+  rf.escape_image_h = v1.RF.escape_image_h;
+  rf.image_loaded = v1.RF.image_loaded;
+  rf.light_pos_r = v1.RF.light_pos_r;
+  rf.light_pos_i = v1.RF.light_pos_i;
+  rf.light_angle = v1.RF.light_angle;
+  rf.light_height = v1.RF.light_height;
+  rf.random_sample = v1.RF.random_sample;
+  rf.original_width = v1.RF.original_width;
+  rf.original_height = v1.RF.original_height;
+  rf.palette_offset = 0;
+  return true;
+}
+
+inline bool write_key_file(const std::string &filename,
+                           const SavedFractal &sf) {
+  std::ofstream key(filename.c_str(), std::ios::out | std::ios::binary);
+  std::string bytes = encode_key(sf);
+  key.write(bytes.data(), bytes.size());
+  return key.good();
+}
+
+//#include "fractals.h" SampleStats
+// struct SampleStats {
+//   unsigned long long rejected; // skipInSet check
+//   unsigned long long in_set;
+//   unsigned long long escaped_set;
+//   unsigned long long total;
+//   //stats for thread efficiency and total thread progress
+//   unsigned long long samples_per_second; //i.e. "total" - not hits
+//   std::chrono::time_point<chrono::steady_clock> next_second_start;
+//   unsigned long long samples_last_second;
+// };
+
+// Distance estimate coloring: pixels further than this from the set all
+// get the far end of the palette
+const double DE_SATURATION_PIXELS = 2.0;
+
+// palette position x in [0, 1] moved along by R.palette_offset (wraps)
+inline double palette_shift(double x) {
+  if (R.palette_offset == 0) return x;
+  x += R.palette_offset;
+  return x - floor(x);
+}
+
+inline void get_iteration_color(const int iter_ix, const int iters_max,
+                                const std::complex<double> &zfinal,
+                                std::complex<double> &derivative, int *p_rcolor,
+                                int *p_gcolor, int *p_bcolor) {
+  // palette: UF16, Viridis, Plasma, Jet, Hot, Heat, Parula, Gray, Cividis,
+  // Github, UF16(added) cycle_size: 8,16,32,64,128,256 color_algo: Smooth,
+  // MultiCycle
+
+  if (R.color_algo == ColoringAlgo::USE_IMAGE) {
+    double rd, ri;
+    double xi, yi;
+    xi = std::abs(modf(zfinal.real() * 2, &rd));
+    yi = std::abs(modf(zfinal.imag() * 2, &ri));
+    // xi = abs(zfinal.real() - (long long)zfinal.real());
+    // yi = abs(zfinal.imag() - (long long)zfinal.imag());
+    sf::Color color = NSR.escape_image.getPixel(sf::Vector2u(
+                                     (unsigned int)(xi * (R.escape_image_w - 1)),
+                                     (unsigned int)(yi * (R.escape_image_h - 1))
+                                     ));
+    *p_rcolor = color.r;
+    *p_gcolor = color.g;
+    *p_bcolor = color.b;
+    return;
+  } else if (R.color_algo == ColoringAlgo::SHADOW_MAP) {
+    const double h2 = R.light_height;  // height factor of the incoming light
+    const double angle = R.light_angle / 360;  // incoming direction of light
+    const std::complex<double> I(0.0, 1.0);
+    std::complex<double> u;
+    double t;
+    const double pi = 3.14159265358979323846;
+    std::complex<double> v = std::exp(
+        I * std::complex<double>((angle * 2 * pi),
+                                 0));  // unit 2D vector in this direction
+    // incoming light 3D vector = (v.re, v.im, h2)
+
+    u = zfinal / derivative;
+    u = u / std::abs(u);  // normal vector : (u.re, u.im, 1)
+    t = u.real() * v.real() + u.imag() * v.imag() +
+        h2;            // dot product with the incoming light
+    t = t / (1 + h2);  // rescale so that t does not get bigger than 1
+    if (t < 0) t = 0;
+      // a+t(b-a) black -> white
+#if 0
+		if (p_rcolor != 0) *p_rcolor = t * 255;
+		if (p_gcolor != 0) *p_gcolor = t * 255;
+		if (p_bcolor != 0) *p_bcolor = t * 255;
+#else
+    // colormap
+    int i = (int)(t * 256) % R.color_cycle_size;
+    tinycolormap::Color color(0.0, 0.0, 0.0);
+    if (R.reflect_palette)
+      color = tinycolormap::GetColorR(
+          palette_shift(i / static_cast<double>(R.color_cycle_size)),
+          R.palette);
+    else
+      color = tinycolormap::GetColor(
+          palette_shift(i / static_cast<double>(R.color_cycle_size)),
+          R.palette);
+
+    *p_rcolor = (int)(255 * color.r());
+    *p_gcolor = (int)(255 * color.g());
+    *p_bcolor = (int)(255 * color.b());
+#endif
+    return;
+  } else if (R.color_algo == ColoringAlgo::HISTOGRAM) {
+    // colored after the frame from the escape iteration histogram
+    return;
+  } else if (R.color_algo == ColoringAlgo::DISTANCE_ESTIMATE) {
+    // derivative is dz/dc here: de = |z| log|z| / |dz|
+    // (fractal units, within a factor of 4 of the true distance to the set)
+    // color by the distance measured in pixels: thin filaments that the
+    // iteration count misses still land within a pixel or two of the set
+    double zabs = std::abs(zfinal);
+    double dabs = std::abs(derivative);
+    double t = 1.0;
+    if ((dabs > 0) && (zabs > 1)) {
+      double de = zabs * log(zabs) / dabs;
+      t = pow(de / (DE_SATURATION_PIXELS * R.xdelta), 0.25);
+      if (t > 1.0) t = 1.0;
+    }
+
+    tinycolormap::Color color(0.0, 0.0, 0.0);
+    if (R.reflect_palette)
+      color = tinycolormap::GetColorR(t, R.palette);
+    else
+      color = tinycolormap::GetColor(t, R.palette);
+
+    *p_rcolor = (int)(255 * color.r());
+    *p_gcolor = (int)(255 * color.g());
+    *p_bcolor = (int)(255 * color.b());
+    return;
+  }
+
+  if (R.palette == tinycolormap::ColormapType::UF16) {
+    // Ultra Fractal Default non smooth
+    std::vector<std::vector<int>> mapping(16, std::vector<int>(3));
+    mapping[0] = {66, 30, 15};
+    mapping[1] = {25, 7, 26};
+    mapping[2] = {9, 1, 47};
+    mapping[3] = {4, 4, 73};
+    mapping[4] = {0, 7, 100};
+    mapping[5] = {12, 44, 138};
+    mapping[6] = {24, 82, 177};
+    mapping[7] = {57, 125, 209};
+    mapping[8] = {134, 181, 229};
+    mapping[9] = {211, 236, 248};
+    mapping[10] = {241, 233, 191};
+    mapping[11] = {248, 201, 95};
+    mapping[12] = {255, 170, 0};
+    mapping[13] = {204, 128, 0};
+    mapping[14] = {153, 87, 0};
+    mapping[15] = {106, 52, 3};
+
+    double shift = R.palette_offset - floor(R.palette_offset);
+    int i = (iter_ix + (int)lround(shift * 16)) % 16;
+    if (R.reflect_palette) {
+      i = (iter_ix + (int)lround(shift * 32)) % 32;
+      if (i >= 16) i = 31 - i;
+    }
+
+    *p_rcolor = mapping[i][0];
+    *p_gcolor = mapping[i][1];
+    *p_bcolor = mapping[i][2];
+    return;
+  }
+
+  // Using tinycolormap
+
+  if (R.color_algo == ColoringAlgo::MULTICYCLE) {
+    // colormap non smooth
+    int i = iter_ix % R.color_cycle_size;
+    tinycolormap::Color color(0.0, 0.0, 0.0);
+    if (R.reflect_palette)
+      color = tinycolormap::GetColorR(
+          palette_shift(i / static_cast<double>(R.color_cycle_size)),
+          R.palette);
+    else
+      color = tinycolormap::GetColor(
+          palette_shift(i / static_cast<double>(R.color_cycle_size)),
+          R.palette);
+
+    *p_rcolor = (int)(255 * color.r());
+    *p_gcolor = (int)(255 * color.g());
+    *p_bcolor = (int)(255 * color.b());
+  } else if (R.color_algo == ColoringAlgo::SMOOTH) {
+    double smooth =
+        ((iter_ix + 1 - log(log2(std::abs(zfinal)))));  // 0 -> iters_max
+    tinycolormap::Color color(0.0, 0.0, 0.0);
+    if (R.reflect_palette)
+      color = tinycolormap::GetColorR(palette_shift(smooth / iters_max),
+                                      R.palette);
+    else
+      color = tinycolormap::GetColor(palette_shift(smooth / iters_max),
+                                     R.palette);
+
+    *p_rcolor = (int)(255 * color.r());
+    *p_gcolor = (int)(255 * color.g());
+    *p_bcolor = (int)(255 * color.b());
+  }
+  return;
+
+  // smooth but use chunked colormap
+  //  double smooth = ((iter_ix + 1 - log(log2(abs(z))))); //0 -> iters_max
+
+  // //colormap portions - chunk colormap into 32
+  // double chunked_smooth = std::round(smooth * 8.0)/8.0;
+
+  // const tinycolormap::Color color =
+  // tinycolormap::GetColor(chunked_smooth/static_cast<double>(iters_max),
+  // tinycolormap::ColormapType::Viridis);
+
+  // *p_rcolor = 255*color.r();
+  // *p_gcolor = 255*color.g();
+  // *p_bcolor = 255*color.b();
+
+  // Basic coloring:
+  //     return (255 * iter_ix) / (iters_max - 1);
+  //   smooth coloring ????    mu = N + 1 - log (log  |Z(N)|) / log 2
+  // double smooth = ((iter_ix + 1 - log(log2(abs(z))))/iters_max; //0 -> 1
+
+  // *p_rcolor = (255*iter_ix) / (iters_max);
+  // *p_gcolor = 255 - (255*iter_ix) / (iters_max);
+  // *p_bcolor = clamp(128 + (255*iter_ix) / (iters_max),(unsigned
+  // int)0,(unsigned int)255);
+}
+
+inline void get_iteration_interior_color(const std::complex<double> &zstart,
+                                         const std::complex<double> &zfinal,
+                                         unsigned int iters_max,
+                                         double distancei, double distancer,
+                                         int *p_rcolor, int *p_gcolor,
+                                         int *p_bcolor) {
+  const double pi = 3.14159265358979323846;
+
+  if ((interior_color_adjust == 0) &&
+      (RI.color_algo != InteriorColoringAlgo::SOLID))
+    interior_color_adjust = 1;
+
+  switch (RI.color_algo) {
+    case InteriorColoringAlgo::SOLID: {
+      *p_rcolor = interior_color_adjust & 0xff;
+      *p_gcolor = (interior_color_adjust & 0xff00) >> 8;
+      *p_bcolor = (interior_color_adjust & 0xff0000) >> 16;
+      return;
+    } break;
+    case InteriorColoringAlgo::MULTICYCLE: {
+      if (RI.palette == tinycolormap::ColormapType::UF16) {
+        // Ultra Fractal Default non smooth
+        std::vector<std::vector<int>> mapping(16, std::vector<int>(3));
+        mapping[0] = {66, 30, 15};
+        mapping[1] = {25, 7, 26};
+        mapping[2] = {9, 1, 47};
+        mapping[3] = {4, 4, 73};
+        mapping[4] = {0, 7, 100};
+        mapping[5] = {12, 44, 138};
+        mapping[6] = {24, 82, 177};
+        mapping[7] = {57, 125, 209};
+        mapping[8] = {134, 181, 229};
+        mapping[9] = {211, 236, 248};
+        mapping[10] = {241, 233, 191};
+        mapping[11] = {248, 201, 95};
+        mapping[12] = {255, 170, 0};
+        mapping[13] = {204, 128, 0};
+        mapping[14] = {153, 87, 0};
+        mapping[15] = {106, 52, 3};
+
+        int i = (interior_color_adjust *10 * (int)(distancer + distancei)) % 16;
+        if (R.reflect_palette) {
+          i = (interior_color_adjust * 10 * (int)(distancer + distancei)) % 32;
+          if (i >= 16) i = 31 - i;
+        }
+
+        *p_rcolor = mapping[i][0];
+        *p_gcolor = mapping[i][1];
+        *p_bcolor = mapping[i][2];
+        return;
+      }
+
+      // colormap non smooth
+      int i = (interior_color_adjust * (int)(distancer + distancei)) %
+              RI.color_cycle_size;
+      tinycolormap::Color color(0.0, 0.0, 0.0);
+      if (RI.reflect_palette)
+        color = tinycolormap::GetColorR(
+            i / static_cast<double>(RI.color_cycle_size), RI.palette);
+      else
+        color = tinycolormap::GetColor(
+            i / static_cast<double>(RI.color_cycle_size), RI.palette);
+
+      *p_rcolor = (unsigned int)(255 * color.r());
+      *p_gcolor = (unsigned int)(255 * color.g());
+      *p_bcolor = (unsigned int)(255 * color.b());
+      return;
+    } break;
+    case InteriorColoringAlgo::USE_IMAGE: {
+      double rd, ri;
+      double xi, yi;
+      xi = std::abs(
+          modf(zstart.real() * (2 / (interior_color_adjust*R.displayed_zoom)),
+               &rd));  // -1 -> 1
+      yi = std::abs(modf(
+          zstart.imag() * (2 / (interior_color_adjust * R.displayed_zoom)), &ri));
+      // xi = abs(zstart.real() - (long long)zstart.real());
+      // yi = abs(zstart.imag() - (long long)zstart.imag());
+      double xp = (xi) * (R.escape_image_w - 1);
+      double yp = (yi) * (R.escape_image_h - 1);
+      sf::Color color = NSR.escape_image.getPixel(sf::Vector2u((unsigned int)xp, (unsigned int)yp));
+      *p_rcolor = color.r;
+      *p_gcolor = color.g;
+      *p_bcolor = color.b;
+      return;
+    } break;
+    case InteriorColoringAlgo::TRIG: {
+      *p_rcolor = (int)(255 * (cos(zfinal.imag() + zfinal.real())) * 0.1 *
+                  ((interior_color_adjust / R.displayed_zoom) *
+                   (distancer + distancei))  / (iters_max));
+      *p_gcolor = (int)(255 * (sin(zfinal.real() + zfinal.real())) * 0.1 *
+                  ((interior_color_adjust / R.displayed_zoom) *
+                   (distancer + distancei))  / (iters_max));
+      *p_bcolor = (int)(255 * (atan(zfinal.imag() + zfinal.real())) * 0.1 *
+                  ((interior_color_adjust / R.displayed_zoom) *
+                   (distancer + distancei)) / (iters_max));
+      return;
+    } break;
+    case InteriorColoringAlgo::TRIG2: {
+      return;
+    } break;
+    case InteriorColoringAlgo::DIST: {
+      *p_rcolor = (int)(interior_color_adjust * 255 * (distancer) / (iters_max));
+      *p_gcolor = (int)(interior_color_adjust * 255 * (distancei) / (iters_max));
+      *p_bcolor = (int)(interior_color_adjust * 255 * (distancer + distancei) /
+                        (iters_max));
+      return;
+    } break;
+    case InteriorColoringAlgo::DIST2: {
+      *p_rcolor =
+          (int)(255.0 * (cos(distancer + distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      *p_gcolor =
+          (int)(255.0 * (sin(distancer + distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      *p_bcolor =
+          (int)(255.0 * (atan(distancer + distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      return;
+    } break;
+    case InteriorColoringAlgo::TEMP: {
+      *p_rcolor =
+          (int)(255.0 * (cos(distancer) + sin(distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      *p_gcolor =
+          (int)(255.0 * (sin(distancer) + cos(distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      *p_bcolor =
+          (int)(255.0 * ((distancer + distancei)) *
+                ((1.0 / interior_color_adjust) * (distancer + distancei)) /
+                (iters_max));
+      return;
+      return;
+    } break;
+  }
+}
+
+// Double-double arithmetic: hi + lo with |lo| <= ulp(hi) / 2, about 106
+// bits of mantissa from plain doubles. The escape time Mandelbrot switches
+// to it once pixels get closer than DOUBLE_DOUBLE_XDELTA, where double
+// coordinates and orbits degrade into blocks. Needs IEEE rounding: no
+// -ffast-math.
+const double DOUBLE_DOUBLE_XDELTA = 1e-13;
+
+struct DoubleDouble {
+  double hi;
+  double lo;
+};
+
+// a + b as the rounded sum and its exact error
+inline DoubleDouble two_sum(double a, double b) {
+  double s = a + b;
+  double bb = s - a;
+  return DoubleDouble{s, (a - (s - bb)) + (b - bb)};
+}
+
+// two_sum for |a| >= |b|
+inline DoubleDouble quick_two_sum(double a, double b) {
+  double s = a + b;
+  return DoubleDouble{s, b - (s - a)};
+}
+
+// a * b as the rounded product and its exact error
+inline DoubleDouble two_prod(double a, double b) {
+  double p = a * b;
+#ifdef __FMA__
+  return DoubleDouble{p, std::fma(a, b, -p)};
+#else
+  // Dekker: split each factor into 26 bit halves whose products are exact
+  const double split = 134217729.0;  // 2^27 + 1
+  double t = split * a;
+  double ah = t - (t - a);
+  double al = a - ah;
+  t = split * b;
+  double bh = t - (t - b);
+  double bl = b - bh;
+  return DoubleDouble{p, ((ah * bh - p) + ah * bl + al * bh) + al * bl};
+#endif
+}
+
+inline DoubleDouble dd_add(DoubleDouble a, DoubleDouble b) {
+  DoubleDouble s = two_sum(a.hi, b.hi);
+  DoubleDouble t = two_sum(a.lo, b.lo);
+  s = quick_two_sum(s.hi, s.lo + t.hi);
+  return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+inline DoubleDouble dd_add(DoubleDouble a, double b) {
+  DoubleDouble s = two_sum(a.hi, b);
+  return quick_two_sum(s.hi, s.lo + a.lo);
+}
+
+inline DoubleDouble dd_sub(DoubleDouble a, DoubleDouble b) {
+  return dd_add(a, DoubleDouble{-b.hi, -b.lo});
+}
+
+inline DoubleDouble dd_mul(DoubleDouble a, DoubleDouble b) {
+  DoubleDouble p = two_prod(a.hi, b.hi);
+  return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+inline DoubleDouble dd_mul(DoubleDouble a, double b) {
+  DoubleDouble p = two_prod(a.hi, b);
+  return quick_two_sum(p.hi, p.lo + a.lo * b);
+}
+
+// (a, a_lo) - (b, b_lo), for offsets between nearby frames
+inline double start_difference(double a, double a_lo, double b, double b_lo) {
+  return dd_sub(DoubleDouble{a, a_lo}, DoubleDouble{b, b_lo}).hi;
+}
+
+// (hi, lo) += d
+inline void dd_accumulate(double &hi, double &lo, double d) {
+  DoubleDouble s = dd_add(DoubleDouble{hi, lo}, d);
+  hi = s.hi;
+  lo = s.lo;
+}
+
+// Long iteration loops check every CANCEL_CHECK_ITERS iterations whether
+// the frame generation *p_seen they work for was abandoned (nullptr: never)
+const unsigned int CANCEL_CHECK_ITERS = 1024;
+inline bool frame_cancelled(const unsigned int *p_seen);
+
+// What a pixel's color is made from. The tile cache keeps these rather
+// than colors so a tile can be recolored with other coloring settings
+// without iterating it again.
+struct EscapeSample {
+  unsigned int iters = 0;
+  int root = 0;   // Newton: roots() index it reached
+  double zr = 0;  // final z
+  double zi = 0;
+  double ar = 0;  // escaped: derivative (shadow map: for a light at 1),
+  double ai = 0;  // interior: orbit distances (real, imaginary)
+};
+
+// color a Mandelbrot/Julia sample, point is the pixel (interior images)
+inline void mandelbrot_shade(const EscapeSample &s, std::complex<double> point,
+                             unsigned int iters_max, int *p_rcolor,
+                             int *p_gcolor, int *p_bcolor) {
+  std::complex<double> z(s.zr, s.zi);
+  if (s.iters < iters_max) {
+    std::complex<double> derivative(s.ar, s.ai);
+    if (R.color_algo == ColoringAlgo::SHADOW_MAP)
+      derivative *= std::complex<double>(R.light_pos_r, R.light_pos_i);
+    get_iteration_color(s.iters, iters_max, z, derivative, p_rcolor, p_gcolor,
+                        p_bcolor);
+  } else {  // set interior set color
+    get_iteration_interior_color(point, z, iters_max, s.ai, s.ar, p_rcolor,
+                                 p_gcolor, p_bcolor);
+  }
+}
+
+// The escape time kernels color one pixel and return the iteration count
+// it escaped at (>= iters_max for interior points), p_sample gets what the
+// color was made from. A cancelled kernel returns without coloring or
+// counting the pixel.
+inline unsigned int mandelbrot_iterations_to_escape(
+    double x, double y, unsigned int iters_max, int *p_rcolor, int *p_gcolor,
+    int *p_bcolor, double power, std::complex<double> zconst, double escape_r,
+    bool julia, unsigned long long &in, unsigned long long &out,
+    double *p_distance = nullptr, const unsigned int *p_seen = nullptr,
+    EscapeSample *p_sample = nullptr) {
+  std::complex<double> point(x, y);
+  std::complex<double> z(0, 0);
+  std::complex<double> zn(0, 0);
+  // shadow map light at 1, mandelbrot_shade scales by the real one (the
+  // derivative is linear in it)
+  std::complex<double> dc(1, 0);
+  std::complex<double> derivative = dc;
+  unsigned int iter_ix = 0;
+  double distancei = 0;
+  double distancer = 0;
+  bool distance_estimate = (R.color_algo == ColoringAlgo::DISTANCE_ESTIMATE);
+
+  if (julia) z = point;
+
+  // dz/dc for the distance estimator: z0 = c (julia) so dz starts at 1,
+  // z0 = 0 (mandelbrot) so dz starts at 0 and picks up +1 every iteration
+  if (distance_estimate)
+    derivative =
+        julia ? std::complex<double>(1, 0) : std::complex<double>(0, 0);
+
+  while (std::abs(z) < (escape_r * escape_r) && iter_ix <= iters_max) {
+    if (((iter_ix + 1) % CANCEL_CHECK_ITERS == 0) && frame_cancelled(p_seen))
+      return iter_ix;
+    if (distance_estimate) {
+      if (power == 2)
+        derivative = std::complex<double>(2, 0) * z * derivative;
+      else
+        derivative = power * pow(z, power - 1) * derivative;
+      if (!julia) derivative += std::complex<double>(1, 0);
+    }
+
+    if (julia)
+      zn = pow(z, power) + zconst;  // With Julia you dont add Point
+    else {
+      if (R.color_algo == ColoringAlgo::SHADOW_MAP)
+        derivative = derivative * std::complex<double>(2, 0) * z +
+                     dc;  // shadow map only
+      zn = pow(z, power) + point;
+    }
+    // how far did we travel during orbit
+    distancei += (z.imag() - zn.imag()) * (z.imag() - zn.imag());
+    distancer += (z.real() - zn.real()) * (z.real() - zn.real());
+    z = zn;
+    // z = z*z + point;
+    iter_ix++;
+  }
+
+  if (iter_ix < iters_max)
+    ++out;
+  else
+    ++in;
+
+  if (p_distance != nullptr) *p_distance = 0;
+
+  EscapeSample s;
+  s.iters = iter_ix;
+  s.zr = z.real();
+  s.zi = z.imag();
+  s.ar = (iter_ix < iters_max) ? derivative.real() : distancer;
+  s.ai = (iter_ix < iters_max) ? derivative.imag() : distancei;
+  mandelbrot_shade(s, point, iters_max, p_rcolor, p_gcolor, p_bcolor);
+  if (p_sample != nullptr) *p_sample = s;
+
+  if ((iter_ix < iters_max) && (distance_estimate) && (p_distance != nullptr) &&
+      (std::abs(z) > 1) && (std::abs(derivative) > 0))
+    *p_distance = std::abs(z) * log(std::abs(z)) / std::abs(derivative);
+  return iter_ix;
+}
+
+// mandelbrot_iterations_to_escape for power 2 in double-double, DD_LANES
+// pixels of a row side by side. The orbit is double-double, the escape test,
+// derivative and orbit distances only need the high words.
+const unsigned int DD_LANES = 4;
+
+struct DoubleDoubleLanes {
+  unsigned int iters[DD_LANES];
+  double cr[DD_LANES];  // pixel
+  double ci[DD_LANES];
+  double zr[DD_LANES];  // final z
+  double zi[DD_LANES];
+  double dr[DD_LANES];  // final derivative
+  double di[DD_LANES];
+  double distancer[DD_LANES];
+  double distancei[DD_LANES];
+};
+
+// lanes x[0..n) at row y, returns false if the frame was cancelled
+inline bool mandelbrot_dd_lanes(const DoubleDouble *x, DoubleDouble y,
+                                unsigned int n, unsigned int iters_max,
+                                std::complex<double> zconst, double escape_r,
+                                bool julia, DoubleDoubleLanes &out,
+                                const unsigned int *p_seen) {
+  const unsigned int L = DD_LANES;
+  const bool distance_estimate =
+      (R.color_algo == ColoringAlgo::DISTANCE_ESTIMATE);
+  const bool shadow_map = (R.color_algo == ColoringAlgo::SHADOW_MAP);
+  const double escape4 = escape_r * escape_r * escape_r * escape_r;
+  DoubleDouble cr[L], ci[L], zr[L], zi[L];
+  double dr[L], di[L];
+  bool live[L];
+  unsigned int left = n;
+  for (unsigned int k = 0; k < L; ++k) {
+    DoubleDouble px = x[(k < n) ? k : 0];
+    cr[k] = julia ? DoubleDouble{zconst.real(), 0} : px;
+    ci[k] = julia ? DoubleDouble{zconst.imag(), 0} : y;
+    zr[k] = julia ? px : DoubleDouble{0, 0};
+    zi[k] = julia ? y : DoubleDouble{0, 0};
+    // as in mandelbrot_iterations_to_escape
+    dr[k] = 1;
+    di[k] = 0;
+    if (distance_estimate) {
+      dr[k] = julia ? 1 : 0;
+      di[k] = 0;
+    }
+    live[k] = (k < n);
+    out.cr[k] = px.hi;
+    out.ci[k] = y.hi;
+    out.distancer[k] = 0;
+    out.distancei[k] = 0;
+  }
+
+  for (unsigned int it = 0; left > 0; ++it) {
+    if (((it + 1) % CANCEL_CHECK_ITERS == 0) && frame_cancelled(p_seen))
+      return false;
+    for (unsigned int k = 0; k < L; ++k) {
+      if (!live[k]) continue;
+      double m = zr[k].hi * zr[k].hi + zi[k].hi * zi[k].hi;
+      if ((m >= escape4) || (it > iters_max)) {
+        out.iters[k] = it;
+        live[k] = false;
+        left--;
+      }
+    }
+    for (unsigned int k = 0; k < L; ++k) {
+      if (!live[k]) continue;
+      if (distance_estimate) {  // dz = 2 z dz (+ 1)
+        double t = 2 * (zr[k].hi * dr[k] - zi[k].hi * di[k]);
+        di[k] = 2 * (zr[k].hi * di[k] + zi[k].hi * dr[k]);
+        dr[k] = t + (julia ? 0 : 1);
+      } else if (shadow_map && !julia) {  // dz = 2 z dz + light (at 1)
+        double t = 2 * (zr[k].hi * dr[k] - zi[k].hi * di[k]) + 1;
+        di[k] = 2 * (zr[k].hi * di[k] + zi[k].hi * dr[k]);
+        dr[k] = t;
+      }
+      // z^2 + c = (zr^2 - zi^2 + cr) + (2 zr zi + ci) i
+      DoubleDouble nr =
+          dd_add(dd_sub(dd_mul(zr[k], zr[k]), dd_mul(zi[k], zi[k])), cr[k]);
+      DoubleDouble ni = dd_add(dd_mul(dd_mul(zr[k], zi[k]), 2.0), ci[k]);
+      double ddr = zr[k].hi - nr.hi;
+      double ddi = zi[k].hi - ni.hi;
+      out.distancer[k] += ddr * ddr;
+      out.distancei[k] += ddi * ddi;
+      zr[k] = nr;
+      zi[k] = ni;
+    }
+  }
+  for (unsigned int k = 0; k < L; ++k) {
+    out.zr[k] = zr[k].hi;
+    out.zi[k] = zi[k].hi;
+    out.dr[k] = dr[k];
+    out.di[k] = di[k];
+  }
+  return true;
+}
+
+// color lane k, returns its iterations
+inline unsigned int mandelbrot_dd_color(const DoubleDoubleLanes &l,
+                                        unsigned int k, unsigned int iters_max,
+                                        int *p_rcolor,
+                                        int *p_gcolor, int *p_bcolor,
+                                        unsigned long long &in,
+                                        unsigned long long &out,
+                                        EscapeSample *p_sample = nullptr) {
+  unsigned int iter_ix = l.iters[k];
+
+  if (iter_ix < iters_max)
+    ++out;
+  else
+    ++in;
+
+  EscapeSample s;
+  s.iters = iter_ix;
+  s.zr = l.zr[k];
+  s.zi = l.zi[k];
+  s.ar = (iter_ix < iters_max) ? l.dr[k] : l.distancer[k];
+  s.ai = (iter_ix < iters_max) ? l.di[k] : l.distancei[k];
+  mandelbrot_shade(s, std::complex<double>(l.cr[k], l.ci[k]), iters_max,
+                   p_rcolor, p_gcolor, p_bcolor);
+  if (p_sample != nullptr) *p_sample = s;
+  return iter_ix;
+}
+
+inline void spiral_septagon_shade(const EscapeSample &s,
+                                  unsigned int iters_max, int *p_rcolor,
+                                  int *p_gcolor, int *p_bcolor) {
+  if (s.iters < iters_max) {
+    std::complex<double> z(s.zr, s.zi);
+    std::complex<double> derivative(1, 0);
+    get_iteration_color(s.iters, iters_max, z, derivative, p_rcolor, p_gcolor,
+                        p_bcolor);
+  } else  // set interior set color
+  {
+    if (p_rcolor != 0) *p_rcolor = 0;
+    if (p_gcolor != 0) *p_gcolor = 0;
+    if (p_bcolor != 0) *p_bcolor = 0;
+  }
+}
+
+inline unsigned int spiral_septagon_iterations_to_escape(
+    double x, double y, unsigned int iters_max, int *p_rcolor, int *p_gcolor,
+    int *p_bcolor, double power, std::complex<double> zconst, double escape_r,
+    bool julia, unsigned long long &in, unsigned long long &out,
+    const unsigned int *p_seen = nullptr, EscapeSample *p_sample = nullptr) {
+  std::complex<double> z(x, y);
+  unsigned int iter_ix = 0;
+
+  while (std::abs(z) < (escape_r * escape_r) && iter_ix <= iters_max) {
+    if (((iter_ix + 1) % CANCEL_CHECK_ITERS == 0) && frame_cancelled(p_seen))
+      return iter_ix;
+    z = (pow(z, power) - (0.7 / 5)) / z;
+    iter_ix++;
+  }
+
+  if (iter_ix < iters_max)
+    ++out;
+  else
+    ++in;
+
+  EscapeSample s;
+  s.iters = iter_ix;
+  s.zr = z.real();
+  s.zi = z.imag();
+  spiral_septagon_shade(s, iters_max, p_rcolor, p_gcolor, p_bcolor);
+  if (p_sample != nullptr) *p_sample = s;
+  return iter_ix;
+}
+
+inline std::vector<std::complex<double>> Fz6_roots{
+    std::complex<double>(0.586992498352664, 1.016700830808605),
+    std::complex<double>(-1.17398499670533, 0),
+    std::complex<double>(0.586992498352664, -1.016700830808605),
+    std::complex<double>(-0.4258998211039621, -0.737680128975117),
+    std::complex<double>(0.851799642079243, 0),
+    std::complex<double>(-0.4258998211039621, 0.737680128975117)};
+
+// Newton and Nova for z^6 + z^3 - 1 and user polynomials
+const double NEWTON_TOLERANCE = 0.000001;
+// Newton only looks for the root it reached once the step is this small
+// (steps shrink quadratically near a root, far from one they are large)
+const double NEWTON_ROOT_CHECK_STEP = 0.001;
+// pixels iterated together
+const unsigned int NEWTON_LANES = 4;
+
+// step = p(z) / p'(z) in Horner form: with w = z^3, p = (w + 1) w - 1 and
+// p' = 3 z^2 (2 w + 1). Plain doubles, no pow() and no complex division
+// (which checks for nan/inf every call).
+inline void newton_z6_step(double zr, double zi, double &sr, double &si) {
+  double z2r = zr * zr - zi * zi;
+  double z2i = 2 * zr * zi;
+  double wr = z2r * zr - z2i * zi;
+  double wi = z2r * zi + z2i * zr;
+  double pr = (wr + 1) * wr - wi * wi - 1;
+  double pim = (wr + 1) * wi + wi * wr;
+  double qr = 3 * (z2r * (2 * wr + 1) - z2i * 2 * wi);
+  double qi = 3 * (z2r * 2 * wi + z2i * (2 * wr + 1));
+  double inv = 1.0 / (qr * qr + qi * qi);
+  sr = (pr * qr + pim * qi) * inv;
+  si = (pim * qr - pr * qi) * inv;
+}
+
+// z^6 + z^3 - 1 for newton_lanes
+struct Z6Poly {
+  void step(double zr, double zi, double &sr, double &si) const {
+    newton_z6_step(zr, zi, sr, si);
+  }
+  const std::vector<std::complex<double>> &roots() const { return Fz6_roots; }
+};
+
+// roots of poly (highest power first) by Durand-Kerner: all of them are
+// refined together from points spread around a spiral until they stop moving
+inline std::vector<std::complex<double>>
+poly_roots(std::vector<std::complex<double>> poly) {
+  while (!poly.empty() && (poly[0] == std::complex<double>(0, 0)))
+    poly.erase(poly.begin());
+  if (poly.size() < 2) return {};
+  const size_t degree = poly.size() - 1;
+  const std::complex<double> lead = poly[0];
+  for (auto &c : poly) c /= lead;  // monic
+
+  auto eval = [&](std::complex<double> z) {
+    std::complex<double> p = poly[0];
+    for (size_t k = 1; k < poly.size(); ++k) p = p * z + poly[k];
+    return p;
+  };
+
+  std::vector<std::complex<double>> roots(degree);
+  std::complex<double> seed(0.4, 0.9);
+  roots[0] = 1;
+  for (size_t k = 1; k < degree; ++k) roots[k] = roots[k - 1] * seed;
+
+  for (int it = 0; it < 1000; ++it) {
+    double moved = 0;
+    double size = 1;
+    for (size_t k = 0; k < degree; ++k) {
+      std::complex<double> denom(1, 0);
+      for (size_t j = 0; j < degree; ++j)
+        if (j != k) denom *= roots[k] - roots[j];
+      if (denom == std::complex<double>(0, 0)) denom = 1e-12;
+      std::complex<double> d = eval(roots[k]) / denom;
+      roots[k] -= d;
+      moved = std::max(moved, std::abs(d));
+      size = std::max(size, std::abs(roots[k]));
+    }
+    if (moved < 1e-15 * size) break;
+  }
+  return roots;
+}
+
+// startup check that poly_roots finds real roots of non-monic polynomials:
+// every root of 2z^2 - 8, 2z^3 - 1 and (3+i)z^3 - 2z + 5 must evaluate to ~0
+inline bool poly_roots_check() {
+  const std::vector<std::vector<std::complex<double>>> polys = {
+      {2, 0, -8}, {2, 0, 0, -1}, {std::complex<double>(3, 1), 0, -2, 5}};
+  for (auto &poly : polys) {
+    auto roots = poly_roots(poly);
+    if (roots.size() != poly.size() - 1) return false;
+    for (auto z : roots) {
+      std::complex<double> p = poly[0];
+      for (size_t k = 1; k < poly.size(); ++k) p = p * z + poly[k];
+      if (std::abs(p) > 1e-9 * std::abs(poly[0])) return false;
+    }
+  }
+  return true;
+}
+
+// A user polynomial ready for newton_lanes: the coefficients split into
+// real and imaginary arrays for Horner, p and p' are evaluated in the same
+// pass (p' = p' z + p, p = p z + c), and the roots computed once
+struct PolyNewton {
+  std::vector<double> cr;
+  std::vector<double> ci;
+  std::vector<std::complex<double>> root_list;
+
+  PolyNewton() {}
+  explicit PolyNewton(const std::vector<std::complex<double>> &poly)
+      : root_list(poly_roots(poly)) {
+    for (auto &c : poly) {
+      cr.push_back(c.real());
+      ci.push_back(c.imag());
+    }
+  }
+
+  void step(double zr, double zi, double &sr, double &si) const {
+    double pr = cr[0];
+    double pim = ci[0];
+    double dr = 0;
+    double di = 0;
+    for (size_t k = 1; k < cr.size(); ++k) {
+      double ndr = dr * zr - di * zi + pr;
+      di = dr * zi + di * zr + pim;
+      dr = ndr;
+      double npr = pr * zr - pim * zi + cr[k];
+      pim = pr * zi + pim * zr + ci[k];
+      pr = npr;
+    }
+    double inv = 1.0 / (dr * dr + di * di);
+    sr = (pr * dr + pim * di) * inv;
+    si = (pim * dr - pr * di) * inv;
+  }
+  const std::vector<std::complex<double>> &roots() const { return root_list; }
+};
+
+// PolyNewton for poly, the roots are only recomputed when it changes
+inline PolyNewton poly_newton(const std::vector<std::complex<double>> &poly) {
+  static std::mutex m;
+  static std::vector<std::complex<double>> last;
+  static PolyNewton cached;
+  std::lock_guard<std::mutex> guard(m);
+  if ((poly != last) || cached.cr.empty()) {
+    cached = PolyNewton(poly);
+    last = poly;
+  }
+  return cached;
+}
+
+struct NewtonLanes {
+  unsigned int iters[NEWTON_LANES];  // iters_max + 1: never converged
+  double zr[NEWTON_LANES];
+  double zi[NEWTON_LANES];
+  int root[NEWTON_LANES];  // roots() index (Newton)
+};
+
+// Iterate pixels (x[k], y), k < n <= NEWTON_LANES, side by side: every lane
+// does the same arithmetic each step so the steps overlap in the pipeline
+// (and can share vector registers), finished lanes keep their result.
+// NOVA adds zconst each step and stops when the step is small, Newton stops
+// on reaching a root. Poly is Z6Poly or PolyNewton. Returns false if the
+// frame was cancelled.
+template <bool NOVA, typename Poly>
+bool newton_lanes(const double *x, double y, unsigned int n,
+                  unsigned int iters_max, std::complex<double> zconst,
+                  const Poly &poly, NewtonLanes &out,
+                  const unsigned int *p_seen) {
+  const std::vector<std::complex<double>> &roots = poly.roots();
+  const unsigned int L = NEWTON_LANES;
+  const double tol2 = NEWTON_TOLERANCE * NEWTON_TOLERANCE;
+  const double check2 = NEWTON_ROOT_CHECK_STEP * NEWTON_ROOT_CHECK_STEP;
+  double zr[L], zi[L], sr[L], si[L];
+  bool live[L];
+  unsigned int left = n;
+  for (unsigned int k = 0; k < L; ++k) {
+    zr[k] = x[(k < n) ? k : 0];
+    zi[k] = y;
+    live[k] = (k < n);
+    out.iters[k] = iters_max + 1;
+    out.root[k] = 0;
+  }
+
+  for (unsigned int it = 0; (it <= iters_max) && (left > 0); ++it) {
+    if (((it + 1) % CANCEL_CHECK_ITERS == 0) && frame_cancelled(p_seen))
+      return false;
+    for (unsigned int k = 0; k < L; ++k) {
+      poly.step(zr[k], zi[k], sr[k], si[k]);
+      if (NOVA) {
+        sr[k] -= zconst.real();
+        si[k] -= zconst.imag();
+      }
+    }
+    for (unsigned int k = 0; k < L; ++k) {
+      if (!live[k]) continue;
+      zr[k] -= sr[k];
+      zi[k] -= si[k];
+      bool done = false;
+      if (NOVA) {
+        done = (std::abs(sr[k]) < NEWTON_TOLERANCE) &&
+               (std::abs(si[k]) < NEWTON_TOLERANCE);
+      } else if (sr[k] * sr[k] + si[k] * si[k] < check2) {
+        for (unsigned int r = 0; r < roots.size(); ++r) {
+          double dr = zr[k] - roots[r].real();
+          double di = zi[k] - roots[r].imag();
+          if (dr * dr + di * di < tol2) {
+            out.root[k] = (int)r;
+            done = true;
+            break;
+          }
+        }
+      }
+      if (done) {
+        out.iters[k] = it;
+        live[k] = false;
+        left--;
+      }
+    }
+  }
+  for (unsigned int k = 0; k < L; ++k) {
+    out.zr[k] = zr[k];
+    out.zi[k] = zi[k];
+  }
+  return true;
+}
+
+// Newton: colored by which of the roots it reached
+template <bool NOVA>
+void newton_shade(const EscapeSample &s, unsigned int iters_max,
+                  unsigned int roots, int *p_rcolor, int *p_gcolor,
+                  int *p_bcolor) {
+  if (s.iters < iters_max) {
+    std::complex<double> z(s.zr, s.zi);
+    std::complex<double> derivative(1, 0);
+    int color_ix = s.iters;
+    if (!NOVA) {
+      // color the root
+      if (R.palette == tinycolormap::ColormapType::UF16)
+        color_ix = 2 + 2 * s.root;
+      else
+        color_ix = 1 + (iters_max / (roots + 1)) * s.root;
+    }
+    get_iteration_color(color_ix, iters_max, z, derivative, p_rcolor, p_gcolor,
+                        p_bcolor);
+  } else  // set interior set color
+  {
+    if (p_rcolor != 0) *p_rcolor = 0;
+    if (p_gcolor != 0) *p_gcolor = 0;
+    if (p_bcolor != 0) *p_bcolor = 0;
+  }
+}
+
+// color lane k, returns its iterations
+template <bool NOVA>
+unsigned int newton_color(const NewtonLanes &l, unsigned int k,
+                          unsigned int iters_max, unsigned int roots,
+                          int *p_rcolor, int *p_gcolor, int *p_bcolor,
+                          unsigned long long &in, unsigned long long &out,
+                          EscapeSample *p_sample = nullptr) {
+  unsigned int iter_ix = l.iters[k];
+
+  if (iter_ix < iters_max)
+    ++out;
+  else
+    ++in;
+
+  EscapeSample s;
+  s.iters = iter_ix;
+  s.root = l.root[k];
+  s.zr = l.zr[k];
+  s.zi = l.zi[k];
+  newton_shade<NOVA>(s, iters_max, roots, p_rcolor, p_gcolor, p_bcolor);
+  if (p_sample != nullptr) *p_sample = s;
+  return iter_ix;
+}
+
+inline unsigned int nova_z6_iterations_to_escape(
+    double x, double y, unsigned int iters_max, int *p_rcolor, int *p_gcolor,
+    int *p_bcolor, double power, std::complex<double> zconst, double escape_r,
+    bool julia, unsigned long long &in, unsigned long long &out,
+    const unsigned int *p_seen = nullptr) {
+  // Mandelbrot nova
+  //  zconst = z;
+  //  z = Fz6_roots[0];
+  NewtonLanes l;
+  if (!newton_lanes<true>(&x, y, 1, iters_max, zconst, Z6Poly{}, l, p_seen))
+    return 0;
+  return newton_color<true>(l, 0, iters_max, 6, p_rcolor, p_gcolor, p_bcolor,
+                            in, out);
+}
+
+inline unsigned int newton_z6_iterations_to_escape(
+    double x, double y, unsigned int iters_max, int *p_rcolor, int *p_gcolor,
+    int *p_bcolor, double power, std::complex<double> zconst, double escape_r,
+    bool julia, unsigned long long &in, unsigned long long &out,
+    const unsigned int *p_seen = nullptr) {
+  NewtonLanes l;
+  if (!newton_lanes<false>(&x, y, 1, iters_max, zconst, Z6Poly{}, l, p_seen))
+    return 0;
+  return newton_color<false>(l, 0, iters_max, 6, p_rcolor, p_gcolor,
+                             p_bcolor, in, out);
+}
+
+// Escape time kernel registry. getImagePixels looks the formula up once per
+// frame and runs a band loop instantiated for that kernel, so the kernel
+// call inlines and the per pixel path has no dispatch. A new formula needs
+// a FractalFormula value, a kernel struct here and a case in getImagePixels.
+// Kernels run one pixel at a time (LANES 1, run()) or a few side by side.
+
+// the current fractal's settings, read once per frame
+struct EscapeParams {
+  unsigned int max_iters;
+  double power;
+  std::complex<double> zconst;
+  double escape_r;
+  bool julia;
+  PolyNewton poly;  // NEWTON_POLY/NOVA_POLY
+  // the frame's first pixel in double-double and the pixel spacing, for
+  // kernels that make their own coordinates
+  DoubleDouble x0{0, 0};
+  DoubleDouble y0{0, 0};
+  double xdelta = 0;
+  double ydelta = 0;
+};
+
+inline EscapeParams escape_params(const SupportedFractal &f) {
+  EscapeParams p{f.current_max_iters[0], f.current_power, f.current_zconst,
+                 f.current_escape_r, f.julia, PolyNewton()};
+  if ((f.formula == FractalFormula::NEWTON_POLY) ||
+      (f.formula == FractalFormula::NOVA_POLY))
+    p.poly = poly_newton(f.current_poly.size() >= 2 ? f.current_poly
+                                                     : f.default_poly);
+  return p;
+}
+
+// run() colors pixel (x, y) and returns its iterations, p_distance gets a
+// distance estimate for kernels that make one and s what the color was made
+// from. shade() colors such a sample again (pixel (x, y), tile cache).
+struct NoLanes {};
+
+struct MandelbrotKernel {
+  static constexpr unsigned int LANES = 1;
+  using Lanes = NoLanes;
+  static unsigned int run(double x, double y, const EscapeParams &p, int *r,
+                          int *g, int *b, unsigned long long &in,
+                          unsigned long long &out, double *p_distance,
+                          const unsigned int *p_seen, EscapeSample *s) {
+    return mandelbrot_iterations_to_escape(x, y, p.max_iters, r, g, b,
+                                           p.power, p.zconst, p.escape_r,
+                                           p.julia, in, out, p_distance,
+                                           p_seen, s);
+  }
+  static void shade(const EscapeSample &s, double x, double y,
+                    const EscapeParams &p, int *r, int *g, int *b) {
+    mandelbrot_shade(s, std::complex<double>(x, y), p.max_iters, r, g, b);
+  }
+};
+
+struct SpiralSeptagonKernel {
+  static constexpr unsigned int LANES = 1;
+  using Lanes = NoLanes;
+  static unsigned int run(double x, double y, const EscapeParams &p, int *r,
+                          int *g, int *b, unsigned long long &in,
+                          unsigned long long &out, double *,
+                          const unsigned int *p_seen, EscapeSample *s) {
+    return spiral_septagon_iterations_to_escape(x, y, p.max_iters, r, g, b,
+                                                p.power, p.zconst, p.escape_r,
+                                                p.julia, in, out, p_seen, s);
+  }
+  static void shade(const EscapeSample &s, double, double,
+                    const EscapeParams &p, int *r, int *g, int *b) {
+    spiral_septagon_shade(s, p.max_iters, r, g, b);
+  }
+};
+
+// kernels that iterate LANES pixels at once: lanes() iterates columns
+// [i, i + n) of row j (at x[], y), color() colors one of the results
+template <bool NOVA>
+struct NewtonZ6LaneKernel {
+  static constexpr unsigned int LANES = NEWTON_LANES;
+  using Lanes = NewtonLanes;
+  static bool lanes(const double *x, double y, unsigned int, unsigned int,
+                    unsigned int n, const EscapeParams &p, NewtonLanes &out,
+                    const unsigned int *p_seen) {
+    return newton_lanes<NOVA>(x, y, n, p.max_iters, p.zconst, Z6Poly{}, out,
+                              p_seen);
+  }
+  static unsigned int color(const NewtonLanes &l, unsigned int k,
+                            const EscapeParams &p, int *r, int *g, int *b,
+                            unsigned long long &in, unsigned long long &out,
+                            EscapeSample *s) {
+    return newton_color<NOVA>(l, k, p.max_iters, 6, r, g, b, in, out, s);
+  }
+  static void shade(const EscapeSample &s, double, double,
+                    const EscapeParams &p, int *r, int *g, int *b) {
+    newton_shade<NOVA>(s, p.max_iters, 6, r, g, b);
+  }
+};
+using NovaZ6Kernel = NewtonZ6LaneKernel<true>;
+using NewtonZ6Kernel = NewtonZ6LaneKernel<false>;
+
+// user polynomial, compiled Horner loop over the coefficients
+template <bool NOVA>
+struct NewtonPolyLaneKernel {
+  static constexpr unsigned int LANES = NEWTON_LANES;
+  using Lanes = NewtonLanes;
+  static bool lanes(const double *x, double y, unsigned int, unsigned int,
+                    unsigned int n, const EscapeParams &p, NewtonLanes &out,
+                    const unsigned int *p_seen) {
+    return newton_lanes<NOVA>(x, y, n, p.max_iters, p.zconst, p.poly, out,
+                              p_seen);
+  }
+  static unsigned int color(const NewtonLanes &l, unsigned int k,
+                            const EscapeParams &p, int *r, int *g, int *b,
+                            unsigned long long &in, unsigned long long &out,
+                            EscapeSample *s) {
+    return newton_color<NOVA>(l, k, p.max_iters,
+                              (unsigned int)p.poly.roots().size(), r, g, b,
+                              in, out, s);
+  }
+  static void shade(const EscapeSample &s, double, double,
+                    const EscapeParams &p, int *r, int *g, int *b) {
+    newton_shade<NOVA>(s, p.max_iters, (unsigned int)p.poly.roots().size(),
+                       r, g, b);
+  }
+};
+using NovaPolyKernel = NewtonPolyLaneKernel<true>;
+using NewtonPolyKernel = NewtonPolyLaneKernel<false>;
+
+// MandelbrotKernel past double precision (power 2 only), the pixel
+// coordinates are made in double-double from the frame's origin
+struct MandelbrotDDKernel {
+  static constexpr unsigned int LANES = DD_LANES;
+  using Lanes = DoubleDoubleLanes;
+  static bool lanes(const double *, double, unsigned int i, unsigned int j,
+                    unsigned int n, const EscapeParams &p,
+                    DoubleDoubleLanes &out, const unsigned int *p_seen) {
+    DoubleDouble x[DD_LANES];
+    for (unsigned int k = 0; k < n; ++k)
+      x[k] = dd_add(p.x0, two_prod(i + k, p.xdelta));
+    DoubleDouble y = dd_add(p.y0, two_prod(j, p.ydelta));
+    return mandelbrot_dd_lanes(x, y, n, p.max_iters, p.zconst, p.escape_r,
+                               p.julia, out, p_seen);
+  }
+  static unsigned int color(const DoubleDoubleLanes &l, unsigned int k,
+                            const EscapeParams &p, int *r, int *g, int *b,
+                            unsigned long long &in, unsigned long long &out,
+                            EscapeSample *s) {
+    return mandelbrot_dd_color(l, k, p.max_iters, r, g, b, in, out, s);
+  }
+  static void shade(const EscapeSample &s, double x, double y,
+                    const EscapeParams &p, int *r, int *g, int *b) {
+    mandelbrot_shade(s, std::complex<double>(x, y), p.max_iters, r, g, b);
+  }
+};
+
+inline void generate_buddhabrot_trail(const std::complex<double> &c,
+                                      unsigned int iters_max,
+                                      std::vector<std::complex<double>> &trail,
+                                      double power, std::complex<double> zconst,
+                                      double escape_r, bool julia, bool anti,
+                                      unsigned long long &in,
+                                      unsigned long long &out,
+                                      const unsigned int *p_seen = nullptr) {
+  unsigned int iter_ix = 0;
+  std::complex<double> z(0, 0);
+  // unsigned int max_iters_in_cycle = iters_max; //for long_orbit
+
+  // bool long_orbit = true;
+
+  // Modified Julia to make buddhabrot do something
+  if (julia) {
+    z = c;
+    zconst = zconst + c;
+  }
+
+  bool cycles = true;
+  if (cycles) {
+    struct complex_double_hash {
+      std::size_t operator()(const std::complex<double> &c) const {
+        return std::hash<double>()(c.real()) ^ std::hash<double>()(c.imag());
+      }
+    };
+
+    std::unordered_map<std::complex<double>, long, complex_double_hash>
+        point_trail;
+    // unordered_map<long, std::complex<double>> cycle_present;
+
+    trail.clear();
+    trail.reserve(iters_max + 1);
+
+    while (iter_ix < iters_max && std::abs(z) < (escape_r * escape_r)) {
+      if (((iter_ix + 1) % CANCEL_CHECK_ITERS == 0) &&
+          frame_cancelled(p_seen)) {
+        trail.clear();  // abandoned sample leaves no hits
+        return;
+      }
+      if (julia)
+        z = pow(z, power) + zconst;  // With Julia you dont add Point usually
+      else
+        z = pow(z, power) + c;
+      // z = z*z + c;
+
+      auto search = point_trail.find(z);
+      if (search != point_trail.end()) {
+        // max_iters_in_cycle = iter_ix;
+        iter_ix = iters_max;
+        break;
+      }
+      point_trail[z] = iter_ix;
+
+      ++iter_ix;
+      trail.push_back(z);
+    }
+
+  } else {
+    trail.clear();
+    trail.reserve(iters_max + 1);
+
+    while (iter_ix < iters_max && std::abs(z) < 2.0) {
+      if (julia)
+        z = pow(z, power) + zconst;  // With Julia you dont add Point usually
+      else
+        z = pow(z, power) + c;
+      // z = z*z + c;
+      ++iter_ix;
+      trail.push_back(z);
+    }
+  }
+
+  //
+  if (iter_ix == iters_max) {
+    // ANTI
+    ++in;
+    if (!anti) trail.clear();  // reject in set points for regular buddhabrot
+
+    // if ((cycles) && (max_iters_in_cycle < ((31/32) * iters_max)))
+    // trail.clear(); if ((cycles) && (max_iters_in_cycle == iters_max))
+    // trail.clear();
+
+    // if (long_orbit) trail.clear();
+  } else {
+    // REGULAR
+    ++out;
+
+    // if (long_orbit) {
+    //   if (iter_ix < (15/16)*iters_max) {trail.clear(); return;}
+    //   else return;
+    // }
+
+    if (anti) trail.clear();  // reject escaped points for anti-buddhabrot
+  }
+
+  // return trail
+}
+
+// Worker thread control. The GUI pauses, resets and terminates the fractal
+// threads through here: idle or paused workers block on a condition variable
+// instead of sleeping and polling, and every reset (zoom, pan, new
+// parameters) bumps a generation counter that workers compare against the
+// one they started with between pixels/samples, so a request for 2 zooms in
+// a row quickly doesnt finish the first one.
+class WorkerControl {
+ public:
+  // before starting the threads (again, after terminate() and join)
+  void setThreads(unsigned int num_threads) {
+    run = false;
+    quit = false;
+    started = 0;
+    parked = 0;
+    passes.reset(new std::atomic<unsigned int>[num_threads]);
+    pass_generation.reset(new std::atomic<unsigned int>[num_threads]);
+    for (unsigned int tix = 0; tix < num_threads; ++tix) {
+      passes[tix] = 0;
+      pass_generation[tix] = 0;
+    }
+  }
+
+  // GUI side
+
+  // start a new frame: workers abandon the current one, returns its
+  // generation
+  unsigned int reset() {
+    unsigned int g;
+    reset_at.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                   std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(m);
+      g = gen.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+    wake.notify_all();
+    return g;
+  }
+
+  // stop using cpu, optionally until every started worker is parked
+  void pause(bool wait_until_idle) {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      run.store(false);
+    }
+    if (!wait_until_idle) return;
+    std::unique_lock<std::mutex> lock(m);
+    idle.wait(lock, [&] { return parked == started; });
+  }
+
+  void resume() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      run.store(true);
+    }
+    wake.notify_all();
+  }
+
+  void terminate() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      quit.store(true);
+    }
+    wake.notify_all();
+  }
+
+  bool running() const { return run.load(); }
+  // steady_clock ticks of the last reset (profiler reset latency)
+  long long resetTime() const {
+    return reset_at.load(std::memory_order_relaxed);
+  }
+  unsigned int generation() const {
+    return gen.load(std::memory_order_acquire);
+  }
+
+  // worker tix finished at least `needed` passes of the current frame
+  bool passed(unsigned int tix, unsigned int needed) const {
+    if (pass_generation[tix].load(std::memory_order_acquire) != generation())
+      return false;
+    return passes[tix].load() >= needed;
+  }
+
+  // every worker finished at least `needed` passes of the current frame
+  bool framePassed(unsigned int num_threads, unsigned int needed) const {
+    for (unsigned int tix = 0; tix < num_threads; ++tix) {
+      if (!passed(tix, needed)) return false;
+    }
+    return true;
+  }
+
+  // Worker side
+
+  void threadStarted() {
+    std::lock_guard<std::mutex> lock(m);
+    ++started;
+  }
+
+  // cheap check for the inner loops: drop the pass we started at `seen`
+  bool interrupted(unsigned int seen) const {
+    return (gen.load(std::memory_order_relaxed) != seen) ||
+           !run.load(std::memory_order_relaxed);
+  }
+
+  // Block until there is work. seen is the generation the worker last
+  // started and done says it has nothing left to do for it; both are
+  // updated when a new frame begins. Returns false when the thread should
+  // exit.
+  bool waitForWork(unsigned int tix, unsigned int &seen, bool &done) {
+    unsigned int g = generation();
+    if (run.load() && !quit.load() && !(done && (g == seen))) {
+      if (g != seen) newFrame(tix, g, seen, done);
+      return true;
+    }
+
+    std::unique_lock<std::mutex> lock(m);
+    ++parked;
+    idle.notify_all();
+    wake.wait(lock, [&] {
+      return quit.load() || (run.load() && !(done && (generation() == seen)));
+    });
+    --parked;
+    if (quit.load()) return false;
+    g = generation();
+    if (g != seen) newFrame(tix, g, seen, done);
+    return true;
+  }
+
+  void passDone(unsigned int tix, unsigned int seen) {
+    if (pass_generation[tix].load(std::memory_order_relaxed) == seen)
+      passes[tix]++;
+  }
+
+ private:
+  void newFrame(unsigned int tix, unsigned int g, unsigned int &seen,
+                bool &done) {
+    seen = g;
+    done = false;
+    passes[tix].store(0);
+    pass_generation[tix].store(g, std::memory_order_release);
+  }
+
+  std::mutex m;
+  std::condition_variable wake;  // workers wait here
+  std::condition_variable idle;  // pause(true) waits here
+  std::atomic<unsigned int> gen{1};
+  std::atomic<bool> run{false};
+  std::atomic<bool> quit{false};
+  std::atomic<long long> reset_at{0};
+  unsigned int started = 0;
+  unsigned int parked = 0;
+
+  // progress of each worker on the current frame (save_and_exit)
+  std::unique_ptr<std::atomic<unsigned int>[]> passes;
+  std::unique_ptr<std::atomic<unsigned int>[]> pass_generation;
+};
+
+inline WorkerControl workers;
+inline bool save_and_exit;
+inline unsigned long long sample_seed = 0;  // random sampling seed, 0: random
+
+inline bool frame_cancelled(const unsigned int *p_seen) {
+  return (p_seen != nullptr) && workers.interrupted(*p_seen);
+}
+
+// cpus listed like "0-15,32-47" in /sys
+inline std::vector<int> parse_cpu_list(const std::string &list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty()) continue;
+    std::size_t dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = (dash == std::string::npos) ? first
+                                             : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    } catch (...) {
+    }
+  }
+  return cpus;
+}
+
+// Cpus to pin workers to, taking one from each NUMA node in turn so that
+// any number of workers is spread evenly over the nodes (and their memory
+// controllers). Empty if the topology is unknown: workers are not pinned.
+inline std::vector<int> worker_cpu_order() {
+  std::vector<int> order;
+#ifdef __linux__
+  std::vector<std::vector<int>> nodes;
+  for (unsigned int node = 0;; ++node) {
+    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) +
+                    "/cpulist");
+    if (!f) break;
+    std::string list;
+    std::getline(f, list);
+    std::vector<int> cpus = parse_cpu_list(list);
+    if (!cpus.empty()) nodes.push_back(cpus);
+  }
+  if (nodes.empty()) {  // no NUMA info: one node with every cpu
+    std::vector<int> cpus;
+    for (unsigned int cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+      cpus.push_back(cpu);
+    nodes.push_back(cpus);
+  }
+
+  // only the cpus this process may run on (taskset, cgroups)
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return order;
+
+  for (size_t i = 0;; ++i) {
+    bool any = false;
+    for (auto &cpus : nodes) {
+      if (i >= cpus.size()) continue;
+      any = true;
+      if ((cpus[i] < CPU_SETSIZE) && CPU_ISSET(cpus[i], &allowed))
+        order.push_back(cpus[i]);
+    }
+    if (!any) break;
+  }
+#endif
+  return order;
+}
+
+inline std::vector<int> worker_cpus;  // filled in main, see worker_cpu_order()
+
+// Pin the calling worker to its cpu. Call before it allocates its buffers so
+// the kernel places their pages on the worker's own NUMA node (first touch).
+inline void pin_worker_thread(unsigned int tix) {
+  if (worker_cpus.empty()) return;
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(worker_cpus[tix % worker_cpus.size()], &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+    std::cout << "could not pin thread " << tix << std::endl;
+#endif
+}
+inline bool hide = false;
+
+// need buddhabrot threads not to mess up model
+inline std::mutex thread_result_report_mutex;
+
+// frame buffer rows per texture upload tile
+const unsigned int TILE_ROWS = 32;
+
+// Escape time tiles saved in tile_cache/ so going back to a key, panning
+// back over a place or changing the coloring renders from disk. A tile is
+// TILE_CACHE_SIZE x TILE_CACHE_SIZE EscapeSamples (iterations, final z and
+// what the colorings need) on a grid at the current zoom and is recolored
+// with the current coloring settings when it is loaded. The grid is
+// anchored on the pixel lattice near a multiple of TILE_CACHE_CELL pixels,
+// so pans keep tile coordinates. A tile's file is named by a hash of
+// everything its samples depend on (fractal, power, zconst, escape radius,
+// iterations, polynomial, pixel spacing, grid anchor and tile coordinates),
+// which is also stored in the file and compared on load; files are memory
+// mapped for the copy. Only tiles that took TILE_CACHE_MIN_SECONDS of worker
+// time are kept (a 160KB tile loads in well under a millisecond, cheaper
+// ones are not worth the disk), they are written by a writer thread from a
+// queue of at most TILE_WRITE_QUEUE_MAX tiles (more are dropped, the render
+// workers never wait on the disk) and the oldest files go once the
+// directory passes TILE_CACHE_MAX_BYTES.
+const unsigned int TILE_CACHE_SIZE = 64;
+const double TILE_CACHE_CELL = 1099511627776.0;  // 2^40
+const double TILE_CACHE_PHASES = 64;  // sub pixel grid offsets told apart
+const double TILE_CACHE_MIN_SECONDS = 0.05;
+const unsigned int TILE_WRITE_QUEUE_MAX = 64;  // 10MB of tiles
+const std::uintmax_t TILE_CACHE_MAX_BYTES = 2ull << 30;
+const char TILE_MAGIC[4] = {'F', 'T', 'I', 'L'};
+const std::uint32_t TILE_VERSION = 2;
+inline std::string tile_cache_dir = keys_location + "tile_cache";
+
+inline uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len);
+inline uint32_t crc32(uint32_t crc, const unsigned char *buf, size_t len);
+
+template <typename T>
+void append_bytes(std::string &s, const T &v) {
+  s.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// read only view of a whole file
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &filename) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+      void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        bytes = static_cast<const unsigned char *>(p);
+        size = (size_t)st.st_size;
+      }
+    }
+    close(fd);
+#else
+    // no mmap, read it
+    std::ifstream f(filename, ios::in | ios::binary);
+    if (!f) return;
+    copy.assign(std::istreambuf_iterator<char>(f),
+                std::istreambuf_iterator<char>());
+    bytes = reinterpret_cast<const unsigned char *>(copy.data());
+    size = copy.size();
+#endif
+  }
+  ~MappedFile() {
+#ifndef _WIN32
+    if (bytes != nullptr) munmap(const_cast<unsigned char *>(bytes), size);
+#endif
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const unsigned char *bytes = nullptr;
+  size_t size = 0;
+
+ private:
+#ifdef _WIN32
+  std::string copy;
+#endif
+};
+
+class TileCache {
+ public:
+  ~TileCache() {
+    {
+      std::lock_guard<std::mutex> lock(queue_m);
+      stopping = true;
+    }
+    queued.notify_all();
+    if (writer.joinable()) writer.join();
+  }
+
+  // the tile grid in the current frame and what its samples depend on
+  struct Grid {
+    std::string look;
+    long long ax = 0;  // view pixel of tile (0, 0)'s corner
+    long long ay = 0;
+
+    long long tileX(long long i) const { return floor_div(i - ax); }
+    long long tileY(long long j) const { return floor_div(j - ay); }
+    long long left(long long tx) const { return ax + tx * TILE_CACHE_SIZE; }
+    long long top(long long ty) const { return ay + ty * TILE_CACHE_SIZE; }
+
+    static long long floor_div(long long a) {
+      const long long n = TILE_CACHE_SIZE;
+      return (a >= 0) ? a / n : -((n - 1 - a) / n);
+    }
+  };
+
+  static Grid frameGrid(const SupportedFractal &f) {
+    Grid g;
+    double cx, cy;
+    int px, py;
+    anchor(R.xstart, R.xstart_lo, R.xdelta, cx, g.ax, px);
+    anchor(R.ystart, R.ystart_lo, R.ydelta, cy, g.ay, py);
+
+    std::string &look = g.look;
+    look = f.name;
+    look.push_back('\0');
+    append_bytes(look, f.formula);
+    append_bytes(look, f.julia);
+    append_bytes(look, f.current_power);
+    append_bytes(look, f.current_zconst);
+    append_bytes(look, f.current_escape_r);
+    append_bytes(look, f.current_max_iters[0]);
+    for (auto &c : f.current_poly) append_bytes(look, c);
+    // the derivative the kernels keep depends on the coloring
+    std::uint8_t derivative = 0;
+    if (R.color_algo == ColoringAlgo::DISTANCE_ESTIMATE) derivative = 1;
+    if (R.color_algo == ColoringAlgo::SHADOW_MAP) derivative = 2;
+    append_bytes(look, derivative);
+    append_bytes(look, R.xdelta);
+    append_bytes(look, R.ydelta);
+    append_bytes(look, cx);
+    append_bytes(look, cy);
+    append_bytes(look, px);
+    append_bytes(look, py);
+    append_bytes(look, TILE_CACHE_SIZE);
+    return g;
+  }
+
+  // tile (tx, ty), TILE_CACHE_SIZE rows of TILE_CACHE_SIZE samples
+  bool load(const Grid &g, long long tx, long long ty, EscapeSample *tile) {
+    std::string look = tileLook(g, tx, ty);
+    std::string name = fileName(look);
+    {
+      // misses never touch the file system
+      std::lock_guard<std::mutex> guard(m);
+      scan();
+      if (present.count(name) == 0) return false;
+    }
+    MappedFile f(tile_cache_dir + separator + name);
+    size_t bytes = sizeof(EscapeSample) * TILE_CACHE_SIZE * TILE_CACHE_SIZE;
+    size_t header = sizeof(TILE_MAGIC) + 2 * sizeof(std::uint32_t);
+    if (f.size != header + look.size() + bytes) return false;
+    std::uint32_t h[2];
+    memcpy(h, f.bytes + sizeof(TILE_MAGIC), sizeof(h));
+    if ((memcmp(f.bytes, TILE_MAGIC, sizeof(TILE_MAGIC)) != 0) ||
+        (h[0] != TILE_VERSION) || (h[1] != look.size()) ||
+        (memcmp(f.bytes + header, look.data(), look.size()) != 0))
+      return false;
+    memcpy(tile, f.bytes + header + look.size(), bytes);
+    std::error_code ec;
+    fs::last_write_time(tile_cache_dir + separator + name,
+                        fs::file_time_type::clock::now(), ec);  // lru
+    return true;
+  }
+
+  // hand tile (tx, ty) to the writer thread
+  void submit(const Grid &g, long long tx, long long ty,
+              std::vector<EscapeSample> &&tile) {
+    std::lock_guard<std::mutex> lock(queue_m);
+    if (stopping || (writes.size() >= TILE_WRITE_QUEUE_MAX)) return;
+    if (!writer.joinable()) writer = std::thread(&TileCache::writeTiles, this);
+    writes.push_back(Write{tileLook(g, tx, ty), std::move(tile)});
+    queued.notify_one();
+  }
+
+ private:
+  struct Write {
+    std::string look;
+    std::vector<EscapeSample> tile;
+  };
+
+  // the writer thread: store queued tiles until stopping and drained
+  void writeTiles() {
+    std::unique_lock<std::mutex> lock(queue_m);
+    while (true) {
+      queued.wait(lock, [this] { return !writes.empty() || stopping; });
+      if (writes.empty()) return;
+      Write w = std::move(writes.front());
+      writes.pop_front();
+      lock.unlock();
+      store(w.look, w.tile.data());
+      lock.lock();
+    }
+  }
+
+  void store(const std::string &look, const EscapeSample *tile) {
+    std::string name = fileName(look);
+    std::string path = tile_cache_dir + separator + name;
+    size_t bytes = sizeof(EscapeSample) * TILE_CACHE_SIZE * TILE_CACHE_SIZE;
+    std::uint32_t h[2] = {TILE_VERSION, (std::uint32_t)look.size()};
+    std::error_code ec;
+    fs::create_directories(tile_cache_dir, ec);
+    // whole files only: readers never see a partial one
+    std::string tmp = path + ".tmp" + std::to_string(next_tmp++);
+    {
+      std::ofstream f(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+      f.write(TILE_MAGIC, sizeof(TILE_MAGIC));
+      f.write(reinterpret_cast<const char *>(h), sizeof(h));
+      f.write(look.data(), look.size());
+      f.write(reinterpret_cast<const char *>(tile), bytes);
+      if (!f) {
+        f.close();
+        fs::remove(tmp, ec);
+        return;
+      }
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+      fs::remove(tmp, ec);
+      return;
+    }
+    added(name, sizeof(TILE_MAGIC) + sizeof(h) + look.size() + bytes);
+  }
+
+  // The pixel lattice start + k delta is anchored at the multiple of
+  // TILE_CACHE_CELL pixels nearest start (cell), a view pixel of its own
+  // (a) and a sub pixel phase. A pan by whole pixels keeps all three
+  // unless it crosses half a cell.
+  static void anchor(double start, double start_lo, double delta,
+                     double &cell, long long &a, int &phase) {
+    double span = delta * TILE_CACHE_CELL;  // exact, a power of 2
+    cell = std::nearbyint(start / span);
+    DoubleDouble corner = two_prod(cell, span);
+    double f = start_difference(corner.hi, corner.lo, start, start_lo) / delta;
+    a = llround(f);
+    phase = (int)lround((f - a) * TILE_CACHE_PHASES);
+  }
+
+  static std::string tileLook(const Grid &g, long long tx, long long ty) {
+    std::string look = g.look;
+    append_bytes(look, tx);
+    append_bytes(look, ty);
+    return look;
+  }
+
+  static std::string fileName(const std::string &look) {
+    const unsigned char *b =
+        reinterpret_cast<const unsigned char *>(look.data());
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%08x%08x", crc32c(0, b, look.size()),
+             crc32(0, b, look.size()));
+    return std::string(hex) + ".tile";
+  }
+
+  // what is on disk, once (m held)
+  void scan() {
+    if (scanned) return;
+    scanned = true;
+    std::error_code ec;
+    for (auto &p : fs::directory_iterator(tile_cache_dir, ec)) {
+      total += fs::file_size(p.path(), ec);
+      present.insert(p.path().filename().string());
+    }
+  }
+
+  // account for a new file, dropping the least recently used ones when the
+  // cache gets too big
+  void added(const std::string &name, std::uintmax_t file_bytes) {
+    std::lock_guard<std::mutex> guard(m);
+    std::error_code ec;
+    if (!scanned) {
+      scan();  // finds the new file too
+    } else if (present.insert(name).second) {
+      total += file_bytes;
+    }
+    if (total <= TILE_CACHE_MAX_BYTES) return;
+
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    for (auto &p : fs::directory_iterator(tile_cache_dir, ec))
+      files.emplace_back(fs::last_write_time(p.path(), ec), p.path());
+    std::sort(files.begin(), files.end());
+    for (auto &f : files) {
+      if (total <= TILE_CACHE_MAX_BYTES / 10 * 9) break;
+      std::uintmax_t size = fs::file_size(f.second, ec);
+      if (fs::remove(f.second, ec)) {
+        total -= std::min(total, size);
+        present.erase(f.second.filename().string());
+      }
+    }
+  }
+
+  std::mutex m;
+  bool scanned = false;
+  std::uintmax_t total = 0;
+  std::unordered_set<std::string> present;  // file names in tile_cache_dir
+  unsigned int next_tmp = 0;  // writer thread only
+
+  std::mutex queue_m;
+  std::condition_variable queued;  // a tile was queued or stopping
+  std::deque<Write> writes;
+  std::thread writer;  // started by the first submit
+  bool stopping = false;
+};
+inline TileCache tile_cache;
+
+// Screenshots and movie frames are png encoded and written by a few encoder
+// threads, the render loop only copies the pixels out. The queue is bounded
+// so a movie that renders faster than it compresses waits for a free slot
+// instead of holding every frame in memory.
+const unsigned int EXPORT_ENCODERS = 2;
+const unsigned int EXPORT_QUEUE_MAX = 8;  // 14MB per frame at 2560x1440
+
+class ExportQueue {
+ public:
+  ~ExportQueue() { finish(); }
+
+  // takes the image, the file type comes from the filename extension
+  void submit(std::string filename, sf::Image &&image) {
+    std::unique_lock<std::mutex> lock(m);
+    if (encoders.empty()) {
+      unsigned int n = std::max(
+          1u, std::min(EXPORT_ENCODERS, std::thread::hardware_concurrency()));
+      for (unsigned int e = 0; e < n; ++e)
+        encoders.emplace_back(&ExportQueue::encode, this);
+    }
+    space.wait(lock, [this] { return jobs.size() < EXPORT_QUEUE_MAX; });
+    jobs.push_back(Job{std::move(filename), std::move(image)});
+    work.notify_one();
+  }
+
+  // wait until everything submitted is on disk
+  void flush() {
+    std::unique_lock<std::mutex> lock(m);
+    idle.wait(lock, [this] { return jobs.empty() && (busy == 0); });
+  }
+
+  // flush and stop the encoders
+  void finish() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      if (encoders.empty()) return;
+      stopping = true;
+    }
+    work.notify_all();
+    for (auto &t : encoders) t.join();
+    encoders.clear();
+    stopping = false;
+  }
+
+ private:
+  struct Job {
+    std::string filename;
+    sf::Image image;
+  };
+
+  void encode() {
+    std::unique_lock<std::mutex> lock(m);
+    while (true) {
+      work.wait(lock, [this] { return !jobs.empty() || stopping; });
+      if (jobs.empty()) return;  // stopping and drained
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      busy++;
+      space.notify_one();
+      lock.unlock();
+
+      if (!job.image.saveToFile(job.filename))
+        std::cout << "could not write " << job.filename << std::endl;
+
+      lock.lock();
+      busy--;
+      if (jobs.empty() && (busy == 0)) idle.notify_all();
+    }
+  }
+
+  std::mutex m;
+  std::condition_variable work;   // a job was queued or stopping
+  std::condition_variable space;  // a job left the queue
+  std::condition_variable idle;   // queue empty and nothing encoding
+  std::deque<Job> jobs;
+  std::vector<std::thread> encoders;  // started by the first submit
+  unsigned int busy = 0;
+  bool stopping = false;
+};
+inline ExportQueue exporter;
+
+// Helper threads for the GUI side passes over the whole frame (histogram
+// coloring, buddhabrot rebuilds). They are started by the first pass and
+// parked between passes instead of being created and joined every frame.
+// run() hands out the chunks of one pass to the helpers and the calling
+// thread and returns when all are done.
+class HelperPool {
+ public:
+  ~HelperPool() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : helpers) t.join();
+  }
+
+  // fn(chunk) for every chunk in [0, chunks)
+  void run(unsigned int chunks, const std::function<void(unsigned int)> &fn) {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      if (helpers.empty()) {
+        unsigned int n = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int h = 0; h < n; ++h)
+          helpers.emplace_back(&HelperPool::help, this);
+      }
+      job = &fn;
+      job_chunks = chunks;
+      next = 0;
+      done = 0;
+      pass++;
+    }
+    wake.notify_all();
+    work();
+    std::unique_lock<std::mutex> lock(m);
+    finished.wait(lock, [&] { return (done == job_chunks) && (active == 0); });
+    job = nullptr;
+  }
+
+ private:
+  // take chunks of the current pass until there are none left
+  void work() {
+    while (true) {
+      unsigned int c = next.fetch_add(1);
+      if (c >= job_chunks) return;
+      (*job)(c);
+      if (done.fetch_add(1) + 1 == job_chunks) {
+        std::lock_guard<std::mutex> lock(m);
+        finished.notify_all();
+      }
+    }
+  }
+
+  void help() {
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(m);
+    while (true) {
+      wake.wait(lock, [&] { return stopping || (pass != seen); });
+      if (stopping) return;
+      seen = pass;
+      if (job == nullptr) continue;  // woke after that pass finished
+      active++;
+      lock.unlock();
+      work();
+      lock.lock();
+      if (--active == 0) finished.notify_all();
+    }
+  }
+
+  std::mutex m;
+  std::condition_variable wake;      // a pass started or stopping
+  std::condition_variable finished;  // chunks done or a helper left
+  std::vector<std::thread> helpers;
+  const std::function<void(unsigned int)> *job = nullptr;
+  std::atomic<unsigned int> job_chunks{0};
+  std::atomic<unsigned int> next{0};
+  std::atomic<unsigned int> done{0};
+  unsigned int pass = 0;
+  unsigned int active = 0;  // helpers inside work()
+  bool stopping = false;
+};
+inline HelperPool frame_helpers;
+
+// histogram coloring counts at most this many iterations x helper chunks
+const std::size_t HISTOGRAM_COUNTS = 1u << 20;
+
+// hit counts below this get their tone mapped color from a table
+const unsigned int TONE_LUT_SIZE = 4096;
+// histogram equalization bins (log spaced over 0 -> max hits)
+const unsigned int TONE_HISTOGRAM_BINS = 4096;
+
+// 0 -> 1 brightness for hits out of max_hits (not for ToneMap::HISTOGRAM)
+inline double tone_map_hits(ToneMap op, unsigned long long hits,
+                            unsigned long long max_hits) {
+  if (max_hits == 0) return 0.0;
+  double x = static_cast<double>(hits) / static_cast<double>(max_hits);
+  switch (op) {
+    case ToneMap::LINEAR:
+      return x;
+    case ToneMap::LOG:
+      return log1p(static_cast<double>(hits)) /
+             log1p(static_cast<double>(max_hits));
+    case ToneMap::GAMMA:
+      return pow(x, 1.0 / NSR.tone_gamma);
+    case ToneMap::ASINH:
+      return asinh(NSR.tone_asinh * x) / asinh(NSR.tone_asinh);
+    case ToneMap::SQRT:
+    default:
+      return sqrt(x);
+  }
+}
+
+// histogram bin for hits out of max_hits
+inline unsigned int tone_histogram_bin(unsigned long long hits,
+                                       unsigned long long max_hits) {
+  if (max_hits == 0) return 0;
+  return (unsigned int)((TONE_HISTOGRAM_BINS - 1) *
+                        (log1p(static_cast<double>(hits)) /
+                         log1p(static_cast<double>(max_hits))));
+}
+
+// Render profiler for tuning thread counts and iteration limits. Off by
+// default and then every probe is one relaxed load. The model takes one
+// snapshot per drawn frame for the HUD (i key) and optionally appends it to
+// render_profile.csv/.json (j key).
+class RenderProfiler {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Frame {
+    unsigned long long frame;
+    double secs;                       // since profiling started
+    double interval_ms;                // since the previous snapshot
+    std::vector<double> busy;               // per thread fraction of interval
+    std::vector<unsigned long long> tile_iters;  // per TILE_ROWS band of rows
+    double merge_ms;                   // buddhabrot mergeHits, all threads
+    unsigned long long merges;
+    double rebuild_ms;                 // buddhabrot image from hits
+    double upload_ms;                  // escape time texture upload
+    double reset_latency_ms;           // reset until last worker saw it
+    unsigned long long samples_per_second;
+  };
+
+  // adds its lifetime to an accumulator while profiling
+  class Scope {
+   public:
+    Scope(const RenderProfiler &p, std::atomic<unsigned long long> &acc)
+        : p_acc(p.on() ? &acc : nullptr) {
+      if (p_acc != nullptr) start = Clock::now();
+    }
+    ~Scope() {
+      if (p_acc != nullptr)
+        p_acc->fetch_add(nanos(start), std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<unsigned long long> *p_acc;
+    Clock::time_point start;
+  };
+
+  void setup(unsigned int threads, unsigned int tiles) {
+    num_threads = threads;
+    num_tiles = tiles;
+    busy_ns.reset(new std::atomic<unsigned long long>[threads]);
+    tile_iters.reset(new std::atomic<unsigned long long>[tiles]);
+    clear();
+  }
+
+  bool on() const { return enabled.load(std::memory_order_relaxed); }
+
+  void enable(bool e) {
+    if (e && !on()) {
+      clear();
+      started = last = Clock::now();
+      frames = 0;
+    }
+    if (!e) dump(false);
+    enabled.store(e);
+  }
+
+  bool dumping() const { return csv.is_open(); }
+
+  // start/stop appending one line per frame to the csv and json files
+  void dump(bool d) {
+    if (!d) {
+      if (csv.is_open()) csv.close();
+      if (json.is_open()) json.close();
+      return;
+    }
+    if (dumping()) return;
+    csv.open("render_profile.csv", std::ios::out | std::ios::trunc);
+    json.open("render_profile.json", std::ios::out | std::ios::trunc);
+    csv << "frame,secs,interval_ms,samples_per_second,busy_min,busy_mean,"
+           "busy_max,tile_iters_total,tile_iters_max,merge_ms,merges,"
+           "rebuild_ms,upload_ms,reset_latency_ms"
+        << std::endl;
+  }
+
+  static unsigned long long nanos(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                 start)
+        .count();
+  }
+
+  // worker side
+
+  void addTileIters(unsigned int tile, unsigned long long iters) {
+    tile_iters[tile].fetch_add(iters, std::memory_order_relaxed);
+  }
+
+  // a worker picked up the frame started at reset_time (steady ticks)
+  void frameSeen(long long reset_time) {
+    Clock::time_point reset{Clock::duration(reset_time)};
+    if (reset_time == 0) return;
+    unsigned long long ns = nanos(reset);
+    unsigned long long prev = reset_latency_ns.load();
+    while ((ns > prev) && !reset_latency_ns.compare_exchange_weak(prev, ns)) {
+    }
+  }
+
+  // gui side: collect and zero everything since the last snapshot
+  Frame take(unsigned long long samples_per_second) {
+    Frame f;
+    Clock::time_point now = Clock::now();
+    double interval_ns =
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - last)
+            .count();
+    last = now;
+    f.frame = frames++;
+    f.secs = std::chrono::duration<double>(now - started).count();
+    f.interval_ms = interval_ns / 1e6;
+    for (unsigned int tix = 0; tix < num_threads; ++tix)
+      f.busy.push_back((interval_ns > 0) ? busy_ns[tix].exchange(0) /
+                                               interval_ns
+                                         : 0.0);
+    for (unsigned int t = 0; t < num_tiles; ++t)
+      f.tile_iters.push_back(tile_iters[t].exchange(0));
+    f.merge_ms = merge_ns.exchange(0) / 1e6;
+    f.merges = merges.exchange(0);
+    f.rebuild_ms = rebuild_ns.exchange(0) / 1e6;
+    f.upload_ms = upload_ns.exchange(0) / 1e6;
+    f.reset_latency_ms = reset_latency_ns.exchange(0) / 1e6;
+    f.samples_per_second = samples_per_second;
+    return f;
+  }
+
+  std::string hudText(const Frame &f) const {
+    double bmin, bmean, bmax;
+    unsigned long long itotal, imax;
+    unsigned int tmax;
+    summary(f, bmin, bmean, bmax, itotal, imax, tmax);
+    std::ostringstream out;
+    out << std::fixed;
+    out.precision(2);
+    out << "Profile  frame " << f.interval_ms << " ms  rebuild "
+        << f.rebuild_ms << " ms  upload " << f.upload_ms << " ms  merge "
+        << f.merge_ms << " ms (" << f.merges << ")  reset latency "
+        << f.reset_latency_ms << " ms\n";
+    out.precision(0);
+    out << "Busy threads min/mean/max " << 100 * bmin << "/" << 100 * bmean
+        << "/" << 100 * bmax << "%  sps " << f.samples_per_second << "\n";
+    out << "Iterations " << itotal << "  busiest tile rows "
+        << tmax * TILE_ROWS << "+ : " << imax;
+    if (dumping()) out << "\nDumping to render_profile.csv/.json";
+    return out.str();
+  }
+
+  void write(const Frame &f) {
+    if (!dumping()) return;
+    double bmin, bmean, bmax;
+    unsigned long long itotal, imax;
+    unsigned int tmax;
+    summary(f, bmin, bmean, bmax, itotal, imax, tmax);
+    csv << f.frame << "," << f.secs << "," << f.interval_ms << ","
+        << f.samples_per_second << "," << bmin << "," << bmean << "," << bmax
+        << "," << itotal << "," << imax << "," << f.merge_ms << ","
+        << f.merges << "," << f.rebuild_ms << "," << f.upload_ms << ","
+        << f.reset_latency_ms << "\n";
+    json << "{\"frame\":" << f.frame << ",\"secs\":" << f.secs
+         << ",\"interval_ms\":" << f.interval_ms
+         << ",\"samples_per_second\":" << f.samples_per_second
+         << ",\"merge_ms\":" << f.merge_ms << ",\"merges\":" << f.merges
+         << ",\"rebuild_ms\":" << f.rebuild_ms
+         << ",\"upload_ms\":" << f.upload_ms
+         << ",\"reset_latency_ms\":" << f.reset_latency_ms
+         << ",\"busy\":[";
+    for (size_t i = 0; i < f.busy.size(); ++i)
+      json << (i ? "," : "") << f.busy[i];
+    json << "],\"tile_iters\":[";
+    for (size_t i = 0; i < f.tile_iters.size(); ++i)
+      json << (i ? "," : "") << f.tile_iters[i];
+    json << "]}\n";
+  }
+
+  std::unique_ptr<std::atomic<unsigned long long>[]> busy_ns;  // per thread
+  std::atomic<unsigned long long> merge_ns{0};
+  std::atomic<unsigned long long> merges{0};
+  std::atomic<unsigned long long> rebuild_ns{0};
+  std::atomic<unsigned long long> upload_ns{0};
+
+ private:
+  void clear() {
+    for (unsigned int tix = 0; tix < num_threads; ++tix) busy_ns[tix] = 0;
+    for (unsigned int t = 0; t < num_tiles; ++t) tile_iters[t] = 0;
+    merge_ns = 0;
+    merges = 0;
+    rebuild_ns = 0;
+    upload_ns = 0;
+    reset_latency_ns = 0;
+  }
+
+  static void summary(const Frame &f, double &bmin, double &bmean,
+                      double &bmax, unsigned long long &itotal,
+                      unsigned long long &imax, unsigned int &tmax) {
+    bmin = f.busy.empty() ? 0.0 : 1.0;
+    bmean = 0;
+    bmax = 0;
+    for (double b : f.busy) {
+      bmin = std::min(bmin, b);
+      bmax = std::max(bmax, b);
+      bmean += b / f.busy.size();
+    }
+    itotal = 0;
+    imax = 0;
+    tmax = 0;
+    for (unsigned int t = 0; t < f.tile_iters.size(); ++t) {
+      itotal += f.tile_iters[t];
+      if (f.tile_iters[t] > imax) {
+        imax = f.tile_iters[t];
+        tmax = t;
+      }
+    }
+  }
+
+  std::atomic<bool> enabled{false};
+  unsigned int num_threads = 0;
+  unsigned int num_tiles = 0;
+  std::unique_ptr<std::atomic<unsigned long long>[]> tile_iters;
+  std::atomic<unsigned long long> reset_latency_ns{0};
+  Clock::time_point started;
+  Clock::time_point last;
+  unsigned long long frames = 0;
+  std::ofstream csv;
+  std::ofstream json;
+};
+
+// Overall Model that gets drawn each cycle (by a FractalCanvas, see
+// fractal_canvas.h, the engine itself never touches the gpu)
+class FractalModel {
+ public:
+  // headless: no tile cache (benchmarks and batch renders)
+  FractalModel(unsigned int _view_width, unsigned int _view_height,
+               bool headless = false)
+      : view_width{_view_width},
+        view_height{_view_height},
+        headless{headless} {
+    current_fractal = 0;
+    hitsums = 0;
+    maxred = 0;
+    maxgreen = 0;
+    maxblue = 0;
+    cuda_detected = false;
+    resetStats();
+    R.displayed_zoom = 1.0;
+    R.requested_zoom = 1.0;
+    R.xstart = FRAC[current_fractal].xMinMax[0];
+    R.ystart = FRAC[current_fractal].yMinMax[0];
+    R.xstart_lo = 0;
+    R.ystart_lo = 0;
+    R.current_height = R.original_height;
+    R.current_width = R.original_width;
+    R.reflect_palette = false;
+    R.light_pos_r = 1;
+    R.light_pos_i = 0;
+    R.light_angle = 45;
+    R.light_height = 1.5;
+    R.xdelta =
+        (FRAC[current_fractal].xMinMax[1] - FRAC[current_fractal].xMinMax[0]) /
+        R.original_width;
+    R.ydelta =
+        (FRAC[current_fractal].yMinMax[1] - FRAC[current_fractal].yMinMax[0]) /
+        R.original_height;
+
+    original_view_width = view_width;
+    original_view_height = view_height;
+    // one RGBA frame buffer for the model, the front end's texture is
+    // updated in place from it (takeFrameChanges)
+    pixels.assign((size_t)4 * view_width * view_height, 0);
+    for (size_t p = 3; p < pixels.size(); p += 4) pixels[p] = 255;
+    histogram_pixels = pixels;
+    tile_count = (view_height + TILE_ROWS - 1) / TILE_ROWS;
+    tile_dirty.reset(new std::atomic<bool>[tile_count]);
+    for (unsigned int t = 0; t < tile_count; ++t) tile_dirty[t] = true;
+
+    if (FRAC[current_fractal].probabalistic != true)
+      panFractal(view_width / 2.0, view_height / 2.0);
+    else
+      createBuddhabrot();
+
+    escape_iters.assign((size_t)view_width * view_height, 0);
+    if (!headless) {
+      escape_samples.assign((size_t)view_width * view_height, EscapeSample{});
+      // a view spans at most size / TILE_CACHE_SIZE + 2 grid tiles
+      cache_tiles_x = view_width / TILE_CACHE_SIZE + 2;
+      unsigned int cache_tiles_y = view_height / TILE_CACHE_SIZE + 2;
+      tile_loaded.reset(
+          new std::atomic<unsigned int>[cache_tiles_x * cache_tiles_y]);
+      for (unsigned int t = 0; t < cache_tiles_x * cache_tiles_y; ++t)
+        tile_loaded[t] = 0;
+      cache_rows.assign(cache_tiles_y, CacheRow{});
+    }
+    row_generation.assign(view_height, 0);
+    kept.assign(view_height, KeptSpan{});
+
+    stats[current_fractal].next_second_start = std::chrono::steady_clock::now();
+
+  }
+
+  ~FractalModel() {}
+
+  // switching fractals
+  void reset_fractal_params() {
+    FRAC[current_fractal].current_max_iters =
+        FRAC[current_fractal].default_max_iters;
+    FRAC[current_fractal].current_power = FRAC[current_fractal].default_power;
+    FRAC[current_fractal].current_zconst = FRAC[current_fractal].default_zconst;
+    FRAC[current_fractal].current_escape_r =
+        FRAC[current_fractal].default_escape_r;
+    setPolynomial(FRAC[current_fractal].default_poly);
+  }
+
+  // The workers read current_poly without a lock (escape_params, the tile
+  // cache key), so a new polynomial only goes in while they are parked
+  void setPolynomial(const std::vector<std::complex<double>> &poly) {
+    if (FRAC[current_fractal].current_poly == poly) return;
+    bool was_running = workers.running();
+    workers.pause(true);
+    FRAC[current_fractal].current_poly = poly;
+    workers.reset();
+    if (was_running) workers.resume();
+  }
+
+  // could just be tuning fractal
+  void reset_fractal_and_reference_frame() {
+    R.displayed_zoom = 1.0;
+    R.requested_zoom = 1.0;
+    R.xstart = FRAC[current_fractal].xMinMax[0];
+    R.ystart = FRAC[current_fractal].yMinMax[0];
+    R.xstart_lo = 0;
+    R.ystart_lo = 0;
+    R.xdelta =
+        (FRAC[current_fractal].xMinMax[1] - FRAC[current_fractal].xMinMax[0]) /
+        R.original_width;
+    R.ydelta =
+        (FRAC[current_fractal].yMinMax[1] - FRAC[current_fractal].yMinMax[0]) /
+        R.original_height;
+    R.current_height = R.original_height;
+    R.current_width = R.original_width;
+    R.show_selection = false;  // mouse click on menu is not a selection
+    R.light_pos_r = 1;
+    R.light_pos_i = 0;
+    R.light_angle = 45;
+    R.light_height = 1.5;
+    hitsums = 0;
+    maxred = 0;
+    maxgreen = 0;
+    maxblue = 0;
+
+    resetStats();
+    if (FRAC[current_fractal].probabalistic != true) {
+      zoomFractal(1.0);
+    }
+
+    for (unsigned int tix = 0; tix < this->num_threads; ++tix) {
+      image_wraps[tix] = 0;
+      current_x[tix] = FRAC[current_fractal].xMinMax[0] + deltax * tix;
+      current_y[tix] = FRAC[current_fractal].yMinMax[0] + deltay * tix;
+    }
+    // before clearing the hits: mergeHits drops anything from older frames
+    workers.reset();
+
+    // TODO zero the per thread hits as well
+    std::lock_guard<std::mutex> guard(
+        thread_result_report_mutex);  // keep out other threads
+    // mergeHits maintains these, so clear them again now it cant race us
+    hitsums = 0;
+    maxred = 0;
+    maxgreen = 0;
+    maxblue = 0;
+    redTrailHits.resize(0);
+    greenTrailHits.resize(0);
+    blueTrailHits.resize(0);
+    hits_changes++;
+    if (FRAC[current_fractal].probabalistic == true) createBuddhabrot();
+  }
+
+  // before starting the threads
+  void setThreads(unsigned int threads) {
+    num_threads = threads;
+    current_x.assign(threads, 0.0);
+    current_y.assign(threads, 0.0);
+    image_wraps.assign(threads, 0);
+    profiler.setup(threads, tile_count);
+    worker_stats.reset(new WorkerStats[threads]);
+    for (unsigned int tix = 0; tix < threads; ++tix) {
+      for (unsigned int f = 0; f < STATS_FRACTALS; ++f) {
+        worker_stats[tix].rejected[f] = 0;
+        worker_stats[tix].in_set[f] = 0;
+        worker_stats[tix].escaped_set[f] = 0;
+        worker_stats[tix].total[f] = 0;
+      }
+    }
+    resetStats();
+  }
+
+  // Add a worker's locally kept counts to its counters and zero them. Only
+  // worker tix writes its block, so a relaxed load and store is enough (no
+  // locked read-modify-write).
+  void publishStats(unsigned int tix, SampleStats &counted) {
+    WorkerStats &w = worker_stats[tix];
+    unsigned int f = current_fractal;
+    auto add = [](std::atomic<unsigned long long> &c, unsigned long long n) {
+      if (n != 0)
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    };
+    add(w.rejected[f], counted.rejected);
+    add(w.in_set[f], counted.in_set);
+    add(w.escaped_set[f], counted.escaped_set);
+    add(w.total[f], counted.total);
+    counted.rejected = 0;
+    counted.in_set = 0;
+    counted.escaped_set = 0;
+    counted.total = 0;
+  }
+
+  // the worker counters of fractal f summed (they only ever grow)
+  void sumWorkerStats(unsigned int f, SampleStats &sum) const {
+    sum.rejected = 0;
+    sum.in_set = 0;
+    sum.escaped_set = 0;
+    sum.total = 0;
+    for (unsigned int tix = 0; tix < num_threads; ++tix) {
+      sum.rejected +=
+          worker_stats[tix].rejected[f].load(std::memory_order_relaxed);
+      sum.in_set += worker_stats[tix].in_set[f].load(std::memory_order_relaxed);
+      sum.escaped_set +=
+          worker_stats[tix].escaped_set[f].load(std::memory_order_relaxed);
+      sum.total += worker_stats[tix].total[f].load(std::memory_order_relaxed);
+    }
+  }
+
+  // Restart the stats of every fractal from the current counts. The workers
+  // own their counters, so instead of zeroing them gatherStats subtracts
+  // this baseline.
+  void resetStats() {
+    memset(&stats, 0, sizeof(stats));
+    for (unsigned int f = 0; f < STATS_FRACTALS; ++f)
+      sumWorkerStats(f, stats_baseline[f]);
+  }
+
+  // gui side: sum the worker counters of the current fractal into stats
+  void gatherStats() {
+    unsigned int f = current_fractal;
+    SampleStats sum;
+    sumWorkerStats(f, sum);
+    stats[f].rejected = sum.rejected - stats_baseline[f].rejected;
+    stats[f].in_set = sum.in_set - stats_baseline[f].in_set;
+    stats[f].escaped_set = sum.escaped_set - stats_baseline[f].escaped_set;
+    stats[f].total = sum.total - stats_baseline[f].total;
+  }
+
+  // thread pool is currently started outside the model
+  void fractal_thread(unsigned int tix) {
+    // cout << "fractal thread " << tix << " running with oversampling: " << 4.0
+    // << endl;
+    pin_worker_thread(tix);  // before the hit buffers are touched
+
+    deltax = 1.0 / (4.0 * IMAGE_WIDTH);
+    deltay = 1.0 / (4.0 * IMAGE_HEIGHT);
+    current_x[tix] = FRAC[current_fractal].xMinMax[0] + deltax * tix;
+    current_y[tix] = FRAC[current_fractal].yMinMax[0] + deltay * tix;
+
+    // allocated on the first buddhabrot pass, escape time fractals (and
+    // posters) dont need 88MB of hits per thread
+    std::vector<std::vector<unsigned long long>> redHits;
+    std::vector<std::vector<unsigned long long>> greenHits;
+    std::vector<std::vector<unsigned long long>> blueHits;
+
+    unsigned int seen = 0;  // frame generation being worked on
+    bool done = false;      // nothing more to do until the next frame
+
+    workers.threadStarted();
+
+    unsigned int profiled_seen = 0;
+
+    // sleeps while paused or done, returns false on terminate
+    while (workers.waitForWork(tix, seen, done)) {
+      RenderProfiler::Scope busy(profiler, profiler.busy_ns[tix]);
+      if (profiled_seen != seen) {
+        if (profiler.on()) profiler.frameSeen(workers.resetTime());
+        profiled_seen = seen;
+      }
+
+      // Non Probabalistic fractals: one pass renders the frame
+      if (FRAC[current_fractal].probabalistic != true) {
+        // an interrupted pass is just abandoned, the next one overwrites
+        // the pixels
+        if (!getImagePixels(R.xstart, R.ystart, R.xdelta, R.ydelta, tix,
+                            seen)) {
+          workers.passDone(tix, seen);
+          done = true;
+        }
+        continue;
+      }
+
+      // Probabalistic fractals
+      if (redHits.empty()) {
+        redHits.resize(IMAGE_WIDTH);
+        for (auto &v : redHits) v.resize(IMAGE_HEIGHT);
+        greenHits.resize(IMAGE_WIDTH);
+        for (auto &v : greenHits) v.resize(IMAGE_HEIGHT);
+        blueHits.resize(IMAGE_WIDTH);
+        for (auto &v : blueHits) v.resize(IMAGE_HEIGHT);
+      }
+
+      if ((FRAC[current_fractal].cuda_mode == true) &&
+          (cuda_detected == true)) {
+        // It we are in cuda mode only allow one thread to do something
+        if (tix != 0) {
+          done = true;
+          continue;
+        }
+      }
+
+      // get trail hits - has to be much longer than sleep time above to be
+      // efficient auto start = chrono::high_resolution_clock::now();
+
+      bool interrupted = false;
+      if ((FRAC[current_fractal].cuda_mode == true) &&
+          (cuda_detected == true)) {
+        SampleStats cudastats{0, 0, 0, 0};
+        // device kernel doesnt have context of model object or this c file
+        cuda_generate_buddhabrot_hits(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                      FRAC[current_fractal], cudastats, redHits,
+                                      greenHits, blueHits);
+        publishStats(tix, cudastats);
+        interrupted = workers.interrupted(seen);
+      } else {
+        // threaded version of generate hits (we take advantage of being inside
+        // model object)
+        interrupted =
+            generateMoreTrailHits(redHits, greenHits, blueHits, tix, seen);
+        // linear sampling covered the whole region enough times
+        if (image_wraps[tix] > 8) done = true;
+      }
+
+      // auto end = chrono::high_resolution_clock::now();
+      // cout << "sample time " << tix << " " <<
+      // chrono::duration_cast<chrono::milliseconds>(end - start).count() << "
+      // ms" << endl;
+
+      // merge trail hits into the instance of the class (but dont make image)
+      // unless they belong to an older frame
+      if ((interrupted) || (!mergeHits(redHits, greenHits, blueHits, seen))) {
+        // Clear any data generated so far
+        for (auto &v : redHits) std::fill(v.begin(), v.end(), 0);
+        for (auto &v : greenHits) std::fill(v.begin(), v.end(), 0);
+        for (auto &v : blueHits) std::fill(v.begin(), v.end(), 0);
+        continue;
+      }
+      workers.passDone(tix, seen);
+
+      // Don't update any more if we want to draw just one
+      if (save_and_exit == true) done = workers.passed(tix, 2);
+    }
+
+    // cout << "fractal thread exiting: " << tix << endl;
+  };  // fractal_thread
+
+  // for each color
+  // generate a random sampling of points inside the -2 2 -2, 2 region
+  // for each sample
+  // get the vector trail using the per color max_iters
+  // increment the point in the image size 2Darray every time it shows up in a
+  // vector trail color each pixel according to the amount of times the point
+  // has shown up in all the trails
+  // The hit arrays (3 x 2560 x 1440 counts) only exist while a probabalistic
+  // fractal is shown: made on a reset to one and by the first merge or
+  // rebuild that finds them missing (callers hold the merge mutex)
+  void createBuddhabrot() {
+    if (!redTrailHits.empty()) return;
+    // Initializing the 2-D vector
+    redTrailHits.resize(IMAGE_WIDTH);
+    for (auto &v : redTrailHits) v.resize(IMAGE_HEIGHT);
+    greenTrailHits.resize(IMAGE_WIDTH);
+    for (auto &v : greenTrailHits) v.resize(IMAGE_HEIGHT);
+    blueTrailHits.resize(IMAGE_WIDTH);
+    for (auto &v : blueTrailHits) v.resize(IMAGE_HEIGHT);
+
+  }  // createBuddhabrot
+
+  void cudaPresent() {
+    int count = cuda_info();
+
+    if (count == 0) {
+      cuda_detected = false;
+      return;
+    }
+    cuda_detected = true;
+  }
+
+  void cudaTest() {
+    int count = cuda_info();
+
+    if (count == 0) {
+      cuda_detected = false;
+      return;
+    }
+    cuda_detected = true;
+
+    // test some cuda vector addition and return of sum vector to host
+    // just to see cuda is working
+    cuda_vec_add(IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    // test a prototype API thats very much like the final one we have to write
+    // but doesnt have all the details
+    cuda_generate_hits_prototype(IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    // test some cuda hit generation and return of hits to the host - this is
+    // the real API used by threads
+    SampleStats fakestat;
+    createBuddhabrot();
+    cuda_generate_buddhabrot_hits(IMAGE_WIDTH, IMAGE_HEIGHT,
+                                  FRAC[current_fractal], fakestat, redTrailHits,
+                                  greenTrailHits, blueTrailHits);
+  }
+
+  void saveBuddhabrotTrailToColor(
+      std::vector<std::complex<double>> &trail,
+      std::vector<std::vector<long long unsigned int>> &colorTrailHits) {
+    for (std::complex<double> &c : trail) {
+      // if point is plottable, scale it to be on a pixel and increment the
+      // value for the pixel
+
+      double minx = FRAC[current_fractal].xMinMax[0];
+      double maxx = FRAC[current_fractal].xMinMax[1];
+      double miny = FRAC[current_fractal].yMinMax[0];
+      double maxy = FRAC[current_fractal].yMinMax[1];
+      if ((c.real() <= maxx) && (c.real() >= minx) && (c.imag() <= maxy) &&
+          (c.imag() >= miny)) {
+        // depending on the cast here you might get a faint gridline in your
+        // image so be careful
+        int x = (int)(((c.real() - minx) * R.original_width) / (maxx - minx));
+        int y = (int)(((c.imag() - miny) * R.original_height) / (maxy - miny));
+
+        colorTrailHits[x][y]++;
+      }
+    }
+  }
+
+  bool skipInSet(std::complex<double> sample) {
+    if ((std::abs(sample - std::complex<double>(-1, 0)) < 0.25) ||
+        (std::abs(1.0 - sqrt(1.0 - 4.0 * sample))) < 1.0)
+      return true;
+    return false;
+  }
+
+  // returns true if the frame generation `seen` was interrupted
+  bool generateMoreTrailHits(
+      std::vector<std::vector<unsigned long long>> &redHits,
+      std::vector<std::vector<unsigned long long>> &greenHits,
+      std::vector<std::vector<unsigned long long>> &blueHits, unsigned int tix,
+      unsigned int seen) {
+    bool reset_detected = false;
+
+    if (image_wraps[tix] > 8) {
+      // cout << "thread " << tix << " paused" << endl;
+      return reset_detected;
+    }
+
+    // looks like we need to do this even if not random
+    // if (R.random_sample) {
+    //  Randomly sampled pixels
+    // every thread has its own generator, seeded once per frame (with
+    // sample_seed when set so benchmark runs take the same samples)
+    thread_local std::mt19937_64 re;
+    thread_local unsigned int re_frame = 0;
+    if (re_frame != seen) {
+      if (sample_seed != 0) {
+        re.seed(sample_seed + tix);
+      } else {
+        std::random_device rd;
+        re.seed(rd());
+      }
+      re_frame = seen;
+    }
+    // uniform_real_distribution<double> xDistribution(
+    //     FRAC[current_fractal].xMinMax[0], FRAC[current_fractal].xMinMax[1]);
+    // uniform_real_distribution<double> yDistribution(
+    //     FRAC[current_fractal].yMinMax[0], FRAC[current_fractal].yMinMax[1]);
+    std::uniform_real_distribution<double> xDistribution(-2, 2);
+    std::uniform_real_distribution<double> yDistribution(-2, 2);
+    //}
+
+    // linear sampling window
+    const SupportedFractal &f = FRAC[current_fractal];
+    const bool own_window = (f.sample_window.size() == 4);
+    const double xmin = own_window ? f.sample_window[0] : f.xMinMax[0];
+    const double xmax = own_window ? f.sample_window[1] : f.xMinMax[1];
+    const double ymin = own_window ? f.sample_window[2] : f.yMinMax[0];
+    const double ymax = own_window ? f.sample_window[3] : f.yMinMax[1];
+
+    unsigned long long max_samples =
+        100000;  // large enought to overcome thread sleep time
+    SampleStats counted{0, 0, 0, 0};  // published once at the end
+
+    for (unsigned long long s_ix = 0; s_ix < max_samples; ++s_ix) {
+      // see if we should reset
+      if (workers.interrupted(seen)) {
+        // std::cout << "Reset hits thread requested: " << std::endl;
+        reset_detected = true;
+        break;
+      }
+
+      std::complex<double> sample;
+      if (R.random_sample) {
+        // Randomly sampled pixels
+        sample = {xDistribution(re), yDistribution(re)};
+      } else {
+        // Linearly sampled pixels
+        sample = {current_x[tix], current_y[tix]};
+        double x = current_x[tix] + num_threads * deltax;
+        if (x > xmax) {
+          current_x[tix] = xmin + tix * deltax;
+          current_y[tix] = current_y[tix] + deltay;
+          if (current_y[tix] > ymax) {
+            current_y[tix] = ymin;
+            image_wraps[tix]++;
+            if (image_wraps[tix] > 8) break;
+          }
+        } else
+          current_x[tix] = x;
+      }
+
+      counted.total++;
+
+      if ((FRAC[current_fractal].current_power == 2) &&
+          (FRAC[current_fractal].anti == false) &&
+          (true == skipInSet(sample))) {
+        counted.rejected++;
+        continue;
+      }
+
+      std::vector<std::complex<double>> trail;
+
+      unsigned int red_max_iters = FRAC[current_fractal].current_max_iters[0];
+      unsigned int green_max_iters = FRAC[current_fractal].current_max_iters[1];
+      unsigned int blue_max_iters = FRAC[current_fractal].current_max_iters[2];
+
+      generate_buddhabrot_trail(
+          sample, red_max_iters, trail, FRAC[current_fractal].current_power,
+          FRAC[current_fractal].current_zconst,
+          FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+          FRAC[current_fractal].anti, counted.in_set,
+          counted.escaped_set, &seen);
+      saveBuddhabrotTrailToColor(trail, redHits);
+      if (0 != trail.size()) {
+        sample = std::complex<double>(sample.real(), -sample.imag());
+        generate_buddhabrot_trail(
+            sample, red_max_iters, trail, FRAC[current_fractal].current_power,
+            FRAC[current_fractal].current_zconst,
+            FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+            FRAC[current_fractal].anti, counted.in_set,
+            counted.escaped_set, &seen);
+        saveBuddhabrotTrailToColor(trail, redHits);
+      }
+
+      generate_buddhabrot_trail(
+          sample, green_max_iters, trail, FRAC[current_fractal].current_power,
+          FRAC[current_fractal].current_zconst,
+          FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+          FRAC[current_fractal].anti, counted.in_set,
+          counted.escaped_set, &seen);
+      saveBuddhabrotTrailToColor(trail, greenHits);
+      if (0 != trail.size()) {
+        sample = std::complex<double>(sample.real(), -sample.imag());
+        generate_buddhabrot_trail(
+            sample, green_max_iters, trail, FRAC[current_fractal].current_power,
+            FRAC[current_fractal].current_zconst,
+            FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+            FRAC[current_fractal].anti, counted.in_set,
+            counted.escaped_set, &seen);
+        saveBuddhabrotTrailToColor(trail, greenHits);
+      }
+
+      generate_buddhabrot_trail(
+          sample, blue_max_iters, trail, FRAC[current_fractal].current_power,
+          FRAC[current_fractal].current_zconst,
+          FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+          FRAC[current_fractal].anti, counted.in_set,
+          counted.escaped_set, &seen);
+      saveBuddhabrotTrailToColor(trail, blueHits);
+      if (0 != trail.size()) {
+        sample = std::complex<double>(sample.real(), -sample.imag());
+        generate_buddhabrot_trail(
+            sample, blue_max_iters, trail, FRAC[current_fractal].current_power,
+            FRAC[current_fractal].current_zconst,
+            FRAC[current_fractal].current_escape_r, FRAC[current_fractal].julia,
+            FRAC[current_fractal].anti, counted.in_set,
+            counted.escaped_set, &seen);
+        saveBuddhabrotTrailToColor(trail, blueHits);
+      }
+    }
+    publishStats(tix, counted);
+    return reset_detected;
+  }
+
+  // each thread does this under mutex, returns false (and merges nothing)
+  // if the hits were generated for an older frame than the current one
+  bool mergeHits(std::vector<std::vector<unsigned long long>> &redHits,
+                 std::vector<std::vector<unsigned long long>> &greenHits,
+                 std::vector<std::vector<unsigned long long>> &blueHits,
+                 unsigned int seen) {
+    // auto start = chrono::high_resolution_clock::now();
+    RenderProfiler::Scope timer(profiler, profiler.merge_ns);
+    std::lock_guard<std::mutex> guard(
+        thread_result_report_mutex);  // keep out other threads
+    if (workers.generation() != seen) return false;
+    if (profiler.on()) profiler.merges++;
+    createBuddhabrot();
+    // auto end = chrono::high_resolution_clock::now();
+    // cout << "mutex lock time " <<
+    // chrono::duration_cast<chrono::milliseconds>(end - start).count() << " ms"
+    // << endl; //65 ms
+    unsigned long long total_merged = 0;
+
+    // maxima only grow between resets so track them here while the merged
+    // cells are hot instead of rescanning everything in rebuildImageFromHits
+    unsigned long long mred = maxred;
+    unsigned long long mgreen = maxgreen;
+    unsigned long long mblue = maxblue;
+
+    for (unsigned int i = 0; i < R.original_width; i++) {
+      for (unsigned int j = 0; j < R.original_height; j++) {
+        total_merged += redHits[i][j];
+        redTrailHits[i][j] += redHits[i][j];
+        redHits[i][j] = 0;
+        if (redTrailHits[i][j] > mred) mred = redTrailHits[i][j];
+
+        total_merged += greenHits[i][j];
+        greenTrailHits[i][j] += greenHits[i][j];
+        greenHits[i][j] = 0;
+        if (greenTrailHits[i][j] > mgreen) mgreen = greenTrailHits[i][j];
+
+        total_merged += blueHits[i][j];
+        blueTrailHits[i][j] += blueHits[i][j];
+        blueHits[i][j] = 0;
+        if (blueTrailHits[i][j] > mblue) mblue = blueTrailHits[i][j];
+      }
+    }
+
+    maxred = mred;
+    maxgreen = mgreen;
+    maxblue = mblue;
+    hitsums += total_merged;
+    hits_changes++;
+    return true;
+    // auto mend = chrono::high_resolution_clock::now();
+    // cout << "merge time " << chrono::duration_cast<chrono::milliseconds>(mend
+    // - end).count()<< " ms for: " << total_merged << endl; //65 ms
+  }
+
+  // Color the image from the merged hits (caller holds the merge mutex).
+  // Columns are split between the frame_helpers and the tone mapping of the
+  // common small hit counts comes from a per channel lookup table, which is
+  // only remade when the tone map or that channel's maximum changed. The
+  // maxima and hitsums are already maintained by mergeHits. Nothing is
+  // redone until hits are merged or the tone map changes, returns true if
+  // the pixels were redone.
+  bool rebuildImageFromHits() {
+    createBuddhabrot();
+    const ToneMap op = NSR.tone_map;
+    const ToneLook look{hits_changes, op, NSR.tone_gamma, NSR.tone_asinh};
+    if (look == tone_look) return false;
+    tone_look = look;
+    const unsigned long long maxes[3] = {maxred, maxgreen, maxblue};
+    const std::vector<std::vector<unsigned long long>> *hits[3] = {
+        &redTrailHits, &greenTrailHits, &blueTrailHits};
+    unsigned int chunks = (num_threads > 0) ? num_threads : 1;
+
+    // tone_luts[c].values[h] is the channel value for h hits, for histogram
+    // equalization it is the histogram bin instead
+    for (unsigned int c = 0; c < 3; ++c) {
+      ToneLut &lut = tone_luts[c];
+      if (!lut.values.empty() && (lut.op == op) &&
+          (lut.gamma == NSR.tone_gamma) && (lut.asinh == NSR.tone_asinh) &&
+          (lut.max_hits == maxes[c]))
+        continue;
+      lut.op = op;
+      lut.gamma = NSR.tone_gamma;
+      lut.asinh = NSR.tone_asinh;
+      lut.max_hits = maxes[c];
+      lut.values.resize(TONE_LUT_SIZE);
+      for (unsigned int h = 0; h < TONE_LUT_SIZE; ++h) {
+        if (op == ToneMap::HISTOGRAM)
+          lut.values[h] = (unsigned short)tone_histogram_bin(h, maxes[c]);
+        else
+          lut.values[h] = (unsigned short)std::min(
+              255.0, 255.0 * tone_map_hits(op, h, maxes[c]));
+      }
+    }
+
+    auto lookup = [&](unsigned int c, unsigned long long h) {
+      if (h < TONE_LUT_SIZE) return (unsigned int)tone_luts[c].values[h];
+      if (op == ToneMap::HISTOGRAM) return tone_histogram_bin(h, maxes[c]);
+      return (unsigned int)std::min(255.0,
+                                    255.0 * tone_map_hits(op, h, maxes[c]));
+    };
+
+    // Histogram equalization: count the pixels that got hits per bin (one
+    // histogram per helper chunk, summed after the pass) and turn the bins
+    // into channel values through the cumulative distribution. The counts
+    // and tables are kept between rebuilds.
+    std::vector<unsigned char> *equalized = tone_equalized;
+    if (op == ToneMap::HISTOGRAM) {
+      tone_histograms.assign((size_t)chunks * 3 * TONE_HISTOGRAM_BINS, 0);
+
+      parallelColumns(chunks, [&](unsigned int chunk, unsigned int xs,
+                                  unsigned int xe) {
+        for (unsigned int c = 0; c < 3; ++c) {
+          unsigned long long *histogram =
+              &tone_histograms[(size_t)(chunk * 3 + c) * TONE_HISTOGRAM_BINS];
+          for (unsigned int i = xs; i < xe; i++) {
+            const std::vector<unsigned long long> &column = (*hits[c])[i];
+            for (unsigned int j = 0; j < R.original_height; j++) {
+              if (column[j] != 0) histogram[lookup(c, column[j])]++;
+            }
+          }
+        }
+      });
+
+      std::vector<unsigned long long> &cumulative = tone_cumulative;
+      cumulative.resize(TONE_HISTOGRAM_BINS);
+      for (unsigned int c = 0; c < 3; ++c) {
+        unsigned long long total = 0;
+        for (unsigned int b = 0; b < TONE_HISTOGRAM_BINS; ++b) {
+          for (unsigned int chunk = 0; chunk < chunks; ++chunk)
+            total += tone_histograms[(size_t)(chunk * 3 + c) *
+                                         TONE_HISTOGRAM_BINS + b];
+          cumulative[b] = total;
+        }
+        equalized[c].assign(TONE_HISTOGRAM_BINS, 0);
+        if (total == 0) continue;
+        for (unsigned int b = 0; b < TONE_HISTOGRAM_BINS; ++b)
+          equalized[c][b] = (unsigned char)((255 * cumulative[b]) / total);
+      }
+    }
+
+    parallelColumns(chunks, [&](unsigned int, unsigned int xs,
+                                unsigned int xe) {
+      // one channel at a time down each column so the table lookups stay
+      // in a tight loop over contiguous hits
+      std::vector<unsigned char> channel[3];
+      for (auto &v : channel) v.resize((unsigned int)R.original_height);
+      const size_t stride = (size_t)4 * view_width;
+
+      for (unsigned int i = xs; i < xe; i++) {
+        for (unsigned int c = 0; c < 3; ++c) {
+          const std::vector<unsigned long long> &column = (*hits[c])[i];
+          unsigned char *out = channel[c].data();
+          if (op == ToneMap::HISTOGRAM) {
+            for (unsigned int j = 0; j < R.original_height; j++)
+              out[j] = (column[j] == 0) ? 0
+                                        : equalized[c][lookup(c, column[j])];
+          } else {
+            for (unsigned int j = 0; j < R.original_height; j++)
+              out[j] = (unsigned char)lookup(c, column[j]);
+          }
+        }
+        std::uint8_t *out = &pixels[(size_t)4 * i];
+        for (unsigned int j = 0; j < R.original_height; j++, out += stride) {
+          out[0] = channel[0][j];
+          out[1] = channel[1][j];
+          out[2] = channel[2][j];
+        }
+      }
+    });
+
+    return true;
+  }
+
+  // Render this thread's band of rows straight into the frame buffer,
+  // returns true if the frame generation `seen` was interrupted
+  bool getImagePixels(double xstart, double ystart, double xdelta,
+                      double ydelta, unsigned int tix, unsigned int seen) {
+    const SupportedFractal &f = FRAC[current_fractal];
+    EscapeParams params = escape_params(f);
+    params.x0 = DoubleDouble{xstart, R.xstart_lo};
+    params.y0 = DoubleDouble{ystart, R.ystart_lo};
+    params.xdelta = xdelta;
+    params.ydelta = ydelta;
+    switch (f.formula) {
+      case FractalFormula::SPIRAL_SEPTAGON:
+        return renderBand<SpiralSeptagonKernel>(xstart, ystart, xdelta,
+                                                ydelta, params, tix, seen);
+      case FractalFormula::NOVA_Z6:
+        return renderBand<NovaZ6Kernel>(xstart, ystart, xdelta, ydelta,
+                                        params, tix, seen);
+      case FractalFormula::NEWTON_Z6:
+        return renderBand<NewtonZ6Kernel>(xstart, ystart, xdelta, ydelta,
+                                          params, tix, seen);
+      case FractalFormula::NEWTON_POLY:
+        return renderBand<NewtonPolyKernel>(xstart, ystart, xdelta, ydelta,
+                                            params, tix, seen);
+      case FractalFormula::NOVA_POLY:
+        return renderBand<NovaPolyKernel>(xstart, ystart, xdelta, ydelta,
+                                          params, tix, seen);
+      case FractalFormula::MANDELBROT:
+      default:
+        if ((params.power == 2) &&
+            (std::max(std::abs(xdelta), std::abs(ydelta)) <
+             DOUBLE_DOUBLE_XDELTA))
+          return renderBand<MandelbrotDDKernel>(xstart, ystart, xdelta,
+                                                ydelta, params, tix, seen);
+        return renderBand<MandelbrotKernel>(xstart, ystart, xdelta, ydelta,
+                                            params, tix, seen);
+    }
+  }
+
+  template <typename Kernel>
+  bool renderBand(double xstart, double ystart, double xdelta, double ydelta,
+                  const EscapeParams &params, unsigned int tix,
+                  unsigned int seen) {
+    bool reset_detected = false;
+    SampleStats counted{0, 0, 0, 0};  // published after every row
+
+    // Subdivide y range by tix and num_threads: whole rows are contiguous in
+    // the frame buffer so finished tiles upload as one block
+    unsigned int yrange = (unsigned int)(R.original_height / num_threads);
+    unsigned int ys = tix * yrange;
+    unsigned int ye = (tix + 1) * yrange;
+    if (tix == num_threads - 1) ye = (unsigned int)R.original_height;
+
+    // tile cache: the tiles of each tile row that are on disk are copied in
+    // and recolored when the band gets to it, from_cache marks their columns
+    const bool cached = !headless;
+    TileCache::Grid grid;
+    if (cached) grid = TileCache::frameGrid(FRAC[current_fractal]);
+    std::vector<char> from_cache(R.original_width, 0);
+    long long cache_ty = 0;
+    bool cache_row_loaded = false;
+
+    for (unsigned int j = ys; j < ye; j++) {
+      std::uint8_t *row = &pixels[(size_t)4 * j * view_width];
+      unsigned int *row_iters = &escape_iters[(size_t)j * view_width];
+      EscapeSample *row_samples =
+          cached ? &escape_samples[(size_t)j * view_width] : nullptr;
+      auto row_began = std::chrono::steady_clock::now();
+
+      if (cached && (!cache_row_loaded || (grid.tileY(j) != cache_ty))) {
+        cache_ty = grid.tileY(j);
+        cache_row_loaded = true;
+        if (!loadTileRow<Kernel>(grid, cache_ty, j, ye, xstart, ystart,
+                                 xdelta, ydelta, params, from_cache, seen)) {
+          reset_detected = true;
+          break;
+        }
+      }
+
+      unsigned long long row_iters_sum = 0;  // for the profiler
+      // lane kernels: results for columns [lane_start, lane_end)
+      typename Kernel::Lanes lanes;
+      unsigned int lane_start = 0;
+      unsigned int lane_end = 0;
+
+      // columns a pan carried over from the previous frame
+      unsigned int keep_start = 0;
+      unsigned int keep_end = 0;
+      if (kept[j].gen == seen) {
+        keep_start = kept[j].start;
+        keep_end = kept[j].end;
+      }
+
+      for (unsigned int i = 0; i < R.original_width; i++) {
+        if ((i >= keep_start) && (i < keep_end)) {
+          i = keep_end - 1;
+          continue;
+        }
+        if (from_cache[i]) continue;
+
+        // see if we should reset
+        if (workers.interrupted(seen)) {
+          // std::cout << "Reset thread requested: " << tix << std::endl;
+          reset_detected = true;
+          break;
+        }
+
+        double xi = xstart + i * xdelta;
+        double yj = ystart + j * ydelta;
+        counted.total++;
+
+        int rcolor = 0;
+        int gcolor = 0;
+        int bcolor = 0;
+        unsigned int iters = 0;
+        double distance = 0;
+        EscapeSample sample;
+
+        if constexpr (Kernel::LANES > 1) {
+          if ((i < lane_start) || (i >= lane_end)) {
+            double xs[Kernel::LANES];
+            unsigned int n =
+                std::min(Kernel::LANES, (unsigned int)R.original_width - i);
+            for (unsigned int k = 0; k < n; ++k)
+              xs[k] = xstart + (i + k) * xdelta;
+            lane_start = i;
+            lane_end = i + n;
+            if (!Kernel::lanes(xs, yj, i, j, n, params, lanes, &seen)) {
+              reset_detected = true;
+              break;
+            }
+          }
+          iters = Kernel::color(lanes, i - lane_start, params, &rcolor,
+                                &gcolor, &bcolor, counted.in_set,
+                                counted.escaped_set, &sample);
+        } else {
+          iters = Kernel::run(xi, yj, params, &rcolor, &gcolor, &bcolor,
+                              counted.in_set, counted.escaped_set, &distance,
+                              &seen, &sample);
+        }
+
+        // a kernel cancelled mid pixel leaves nothing to write
+        if (workers.interrupted(seen)) {
+          reset_detected = true;
+          break;
+        }
+        row_iters_sum += iters;
+
+        // The set is at least distance/4 away, so every pixel along the
+        // row that is still DE_SATURATION_PIXELS clear of that disk
+        // is exterior and would get the same saturated color
+        // (its own estimate is at least half its true distance)
+        double clear =
+            0.25 * distance - 2.0 * DE_SATURATION_PIXELS * std::abs(xdelta);
+        if (clear > std::abs(xdelta)) {
+          unsigned int skip = (unsigned int)(clear / std::abs(xdelta));
+          setPixel(row, i, rcolor, gcolor, bcolor);
+          row_iters[i] = iters;
+          if (cached) row_samples[i] = sample;
+          for (unsigned int k = 0; (k < skip) && (i + 1 < R.original_width) &&
+                                   !from_cache[i + 1];
+               ++k) {
+            ++i;
+            setPixel(row, i, rcolor, gcolor, bcolor);
+            row_iters[i] = iters;
+            if (cached) row_samples[i] = sample;
+            counted.total++;
+            counted.rejected++;
+          }
+          continue;
+        }
+
+        setPixel(row, i, rcolor, gcolor, bcolor);
+        row_iters[i] = iters;
+        if (cached) row_samples[i] = sample;
+      }
+
+      publishStats(tix, counted);
+      if (profiler.on()) profiler.addTileIters(j / TILE_ROWS, row_iters_sum);
+      if (reset_detected == true) break;
+      row_generation[j] = seen;
+      tile_dirty[j / TILE_ROWS].store(true, std::memory_order_release);
+      if (cached)
+        tileRowProgress(grid, j,
+                        std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - row_began)
+                            .count(),
+                        seen);
+    }
+    hitsums = (unsigned long long)(R.original_width * R.original_height);
+
+    return reset_detected;
+  }
+
+  // Copy the tiles of tile row ty that are on disk into rows [j, the end of
+  // the tile row or ye) and recolor them; from_cache gets their columns.
+  // Returns false if the frame generation `seen` was interrupted.
+  template <typename Kernel>
+  bool loadTileRow(const TileCache::Grid &grid, long long ty, unsigned int j,
+                   unsigned int ye, double xstart, double ystart,
+                   double xdelta, double ydelta, const EscapeParams &params,
+                   std::vector<char> &from_cache, unsigned int seen) {
+    const long long w = R.original_width;
+    const long long T = TILE_CACHE_SIZE;
+    std::fill(from_cache.begin(), from_cache.end(), 0);
+    unsigned int rows_end =
+        (unsigned int)std::min<long long>(ye, grid.top(ty) + T);
+    std::vector<EscapeSample> tile;
+
+    for (long long tx = grid.tileX(0); tx <= grid.tileX(w - 1); ++tx) {
+      if (workers.interrupted(seen)) return false;
+      if (tile.empty()) tile.resize(T * T);
+      if (!tile_cache.load(grid, tx, ty, tile.data())) continue;
+      tile_loaded[cacheTileIndex(grid, tx, ty)] = seen;
+
+      long long c0 = std::max(0LL, grid.left(tx));
+      long long c1 = std::min(w, grid.left(tx) + T);
+      for (unsigned int r = j; r < rows_end; ++r) {
+        const EscapeSample *src =
+            &tile[(r - grid.top(ty)) * T + (c0 - grid.left(tx))];
+        std::uint8_t *row = &pixels[(size_t)4 * r * view_width];
+        for (long long c = c0; c < c1; ++c, ++src) {
+          int rcolor = 0;
+          int gcolor = 0;
+          int bcolor = 0;
+          Kernel::shade(*src, xstart + c * xdelta, ystart + r * ydelta,
+                        params, &rcolor, &gcolor, &bcolor);
+          setPixel(row, (unsigned int)c, rcolor, gcolor, bcolor);
+          escape_iters[(size_t)r * view_width + c] = src->iters;
+          escape_samples[(size_t)r * view_width + c] = *src;
+        }
+      }
+      std::fill(from_cache.begin() + c0, from_cache.begin() + c1, 1);
+    }
+    return true;
+  }
+
+  // Row j of the frame generation `seen` is done, secs after it started.
+  // The worker that finishes the last row of a tile row queues its tiles
+  // that were computed rather than loaded for writing, if they were slow
+  // enough.
+  void tileRowProgress(const TileCache::Grid &grid, unsigned int j,
+                       double secs, unsigned int seen) {
+    const long long w = R.original_width;
+    const long long T = TILE_CACHE_SIZE;
+    long long ty = grid.tileY(j);
+    // tiles cut by the top or bottom edge are never complete
+    if ((grid.top(ty) < 0) || (grid.top(ty) + T > (long long)view_height))
+      return;
+    {
+      std::lock_guard<std::mutex> guard(cache_rows_mutex);
+      CacheRow &p = cache_rows[ty - grid.tileY(0)];
+      if (p.gen != seen) p = CacheRow{seen, 0, 0};
+      p.rows++;
+      p.secs += secs;
+      if (p.rows != T) return;
+      secs = p.secs;
+    }
+
+    // settings changed under the tiles: they are about to be redrawn, dont
+    // keep them
+    if (workers.interrupted(seen) ||
+        (TileCache::frameGrid(FRAC[current_fractal]).look != grid.look))
+      return;
+    long long tx0 = grid.tileX(0);
+    long long tx1 = grid.tileX(w - 1);
+    unsigned int computed = 0;
+    for (long long tx = tx0; tx <= tx1; ++tx)
+      if (tile_loaded[cacheTileIndex(grid, tx, ty)] != seen) computed++;
+    if ((computed == 0) || (secs / computed < TILE_CACHE_MIN_SECONDS)) return;
+
+    for (long long tx = tx0; tx <= tx1; ++tx) {
+      if ((grid.left(tx) < 0) || (grid.left(tx) + T > w) ||
+          (tile_loaded[cacheTileIndex(grid, tx, ty)] == seen))
+        continue;
+      std::vector<EscapeSample> tile(T * T);
+      for (long long r = 0; r < T; ++r)
+        memcpy(&tile[r * T],
+               &escape_samples[(size_t)(grid.top(ty) + r) * view_width +
+                               grid.left(tx)],
+               sizeof(EscapeSample) * T);
+      if (workers.interrupted(seen)) return;  // rows may be rewritten
+      tile_cache.submit(grid, tx, ty, std::move(tile));
+    }
+  }
+
+  // tile_loaded/cache_rows index of a grid tile in the view
+  size_t cacheTileIndex(const TileCache::Grid &grid, long long tx,
+                        long long ty) {
+    return (size_t)((ty - grid.tileY(0)) * cache_tiles_x +
+                    (tx - grid.tileX(0)));
+  }
+
+  inline void setPixel(std::uint8_t *row, unsigned int i, int rcolor,
+                       int gcolor, int bcolor) {
+    std::uint8_t *p = row + 4 * i;
+    p[0] = (std::uint8_t)rcolor;
+    p[1] = (std::uint8_t)gcolor;
+    p[2] = (std::uint8_t)bcolor;
+  }
+
+  // The workers already wrote the pixels, the front end picks up the tiles
+  // of rows they touched with takeFrameChanges. HISTOGRAM coloring is
+  // recolored into its own buffer first.
+  void setImagePixels(double xstart, double ystart, double xdelta,
+                      double ydelta) {
+    showFrame(R.color_algo == ColoringAlgo::HISTOGRAM);
+    if (showing_histogram && setHistogramImagePixels()) frame_replaced = true;
+  }
+
+  // Hands the front end what changed in the shown frame since the last call
+  // as upload(rgba_rows, first_row, end_row): the whole frame after a pan
+  // shift, a coloring switch, a histogram recolor or a buddhabrot rebuild,
+  // else each run of tiles the workers wrote (one call per run).
+  template <typename F>
+  void takeFrameChanges(F upload) {
+    const std::uint8_t *rgba =
+        showing_histogram ? histogram_pixels.data() : pixels.data();
+    if (frame_replaced) {
+      frame_replaced = false;
+      // (under HISTOGRAM the tiles are left for the next recolor)
+      if (!showing_histogram)
+        for (unsigned int t = 0; t < tile_count; ++t) tile_dirty[t] = false;
+      upload(rgba, 0u, view_height);
+      return;
+    }
+    if (showing_histogram) return;
+
+    unsigned int t = 0;
+    while (t < tile_count) {
+      if (!tile_dirty[t].exchange(false, std::memory_order_acquire)) {
+        ++t;
+        continue;
+      }
+      unsigned int first = t;
+      while ((t + 1 < tile_count) &&
+             (tile_dirty[t + 1].exchange(false, std::memory_order_acquire)))
+        ++t;
+      unsigned int ys = first * TILE_ROWS;
+      unsigned int ye = std::min((t + 1) * TILE_ROWS, view_height);
+      upload(&rgba[(size_t)4 * ys * view_width], ys, ye);
+      ++t;
+    }
+  }
+
+  // fn(chunk, first_column, end_column) for chunks bands of columns on the
+  // frame_helpers
+  template <typename F>
+  void parallelColumns(unsigned int chunks, F fn) {
+    unsigned int xrange = (unsigned int)(R.original_width / chunks);
+    frame_helpers.run(chunks, [&](unsigned int c) {
+      unsigned int xs = c * xrange;
+      unsigned int xe = (c + 1) * xrange;
+      if (c == chunks - 1) xe = (unsigned int)R.original_width;
+      fn(c, xs, xe);
+    });
+  }
+
+  // same for bands of rows
+  template <typename F>
+  void parallelRows(unsigned int chunks, F fn) {
+    unsigned int yrange = (unsigned int)(R.original_height / chunks);
+    frame_helpers.run(chunks, [&](unsigned int c) {
+      unsigned int ys = c * yrange;
+      unsigned int ye = (c + 1) * yrange;
+      if (c == chunks - 1) ye = (unsigned int)R.original_height;
+      fn(c, ys, ye);
+    });
+  }
+
+  // Histogram coloring: a post pass over the stored escape iterations.
+  // Each helper chunk counts its own rows, the counts are summed after the
+  // pass (no locks), and exterior pixels are colored by where their
+  // iteration count falls in the cumulative distribution so the whole
+  // palette is used however large current_max_iters is. It goes to its own
+  // buffer so the workers' pixels (interior colors) are left alone. Only
+  // redone when rows changed or the coloring did; the counts take at most
+  // HISTOGRAM_COUNTS (fewer chunks for more iterations) and are kept
+  // between frames. Returns true if histogram_pixels were redone.
+  bool setHistogramImagePixels() {
+    unsigned int iters_max = FRAC[current_fractal].current_max_iters[0];
+    bool dirty = histogram_stale;  // pixels were shown in between
+    histogram_stale = false;
+    for (unsigned int t = 0; t < tile_count; ++t)
+      if (tile_dirty[t].exchange(false, std::memory_order_acquire))
+        dirty = true;
+    HistogramLook look{iters_max, R.palette, R.reflect_palette,
+                       R.palette_offset};
+    if (!dirty && (look == histogram_look)) return false;
+    histogram_look = look;
+
+    unsigned int chunks = (num_threads > 0) ? num_threads : 1;
+    unsigned int count_chunks = (unsigned int)std::min<std::size_t>(
+        chunks, std::max<std::size_t>(
+                    1, HISTOGRAM_COUNTS / std::max(1u, iters_max)));
+    histogram_counts.assign((size_t)count_chunks * iters_max, 0);
+    const size_t width = view_width;
+
+    auto count = [&](unsigned int c, unsigned int ys, unsigned int ye) {
+      unsigned long long *histogram = &histogram_counts[(size_t)c * iters_max];
+      for (size_t p = ys * width; p < ye * width; p++) {
+        if (escape_iters[p] < iters_max) histogram[escape_iters[p]]++;
+      }
+    };
+    parallelRows(count_chunks, count);
+
+    std::vector<double> &cdf = histogram_cdf;
+    cdf.assign(iters_max, 0.0);
+    unsigned long long escaped = 0;
+    for (unsigned int k = 0; k < iters_max; ++k) {
+      for (unsigned int c = 0; c < count_chunks; ++c)
+        escaped += histogram_counts[(size_t)c * iters_max + k];
+      cdf[k] = (double)escaped;
+    }
+    if (escaped != 0)
+      for (auto &c : cdf) c /= escaped;
+
+    parallelRows(chunks, [&](unsigned int c, unsigned int ys, unsigned int ye) {
+      for (size_t p = ys * width; p < ye * width; p++) {
+        std::uint8_t *out = &histogram_pixels[4 * p];
+        if (escape_iters[p] >= iters_max) {  // interior
+          memcpy(out, &pixels[4 * p], 4);
+          continue;
+        }
+        tinycolormap::Color hcolor(0.0, 0.0, 0.0);
+        if (R.reflect_palette)
+          hcolor = tinycolormap::GetColorR(palette_shift(cdf[escape_iters[p]]),
+                                           R.palette);
+        else
+          hcolor = tinycolormap::GetColor(palette_shift(cdf[escape_iters[p]]),
+                                          R.palette);
+        out[0] = (std::uint8_t)(255 * hcolor.r());
+        out[1] = (std::uint8_t)(255 * hcolor.g());
+        out[2] = (std::uint8_t)(255 * hcolor.b());
+      }
+    });
+
+    return true;
+  }
+
+  // switch the shown frame between pixels and histogram_pixels
+  void showFrame(bool histogram) {
+    if (histogram == showing_histogram) return;
+    showing_histogram = histogram;
+    histogram_stale = histogram;
+    frame_replaced = true;
+  }
+
+  void calculateZoomWindow(double newzoom) {
+    double xratio = newzoom;
+    double yratio = newzoom;
+
+    double minx = FRAC[current_fractal].xMinMax[0];
+    double maxx = FRAC[current_fractal].xMinMax[1];
+    double miny = FRAC[current_fractal].yMinMax[0];
+    double maxy = FRAC[current_fractal].yMinMax[1];
+
+    // mandelbrot_coordinates
+    double xdelta = (maxx - minx) * xratio / R.original_width;
+    double ydelta = (maxy - miny) * yratio / R.original_height;
+    R.xdelta = xdelta;
+    R.ydelta = ydelta;
+
+    // after we zoom, we want to start here
+    // mandelbrot coordinates
+    dd_accumulate(R.xstart, R.xstart_lo,
+                  (maxx - minx) * (R.displayed_zoom - newzoom) / 2.0);
+    double xstart = R.xstart;
+
+    dd_accumulate(R.ystart, R.ystart_lo,
+                  (maxy - miny) * (R.displayed_zoom - newzoom) / 2.0);
+    double ystart = R.ystart;
+
+    R.current_width = newzoom * R.original_width;
+    R.current_height = newzoom * R.original_height;
+
+    R.displayed_zoom = newzoom;
+
+    std::cout << "zoom: " << R.displayed_zoom;
+    std::cout << "  cdims: " << R.current_width << " " << R.current_height
+              << " ";
+    std::cout.precision(10);
+    std::cout << std::scientific << " starts: " << R.xstart << " "
+              << R.ystart << " ";
+    std::cout << "x range: " << std::scientific << xstart << " -> "
+              << xstart + (R.original_width - 1) * xdelta;
+    std::cout << "  y range: " << ystart << " -> "
+              << ystart + (R.original_height - 1) * ydelta << std::fixed
+              << std::endl;
+  }
+
+  // Assumes the user doesnt resize the window to give it different pixels
+  void calculatePanWindow(double xcenter, double ycenter) {
+    double xratio = R.displayed_zoom;
+    double yratio = R.displayed_zoom;
+
+    double minx = FRAC[current_fractal].xMinMax[0];
+    double maxx = FRAC[current_fractal].xMinMax[1];
+    double miny = FRAC[current_fractal].yMinMax[0];
+    double maxy = FRAC[current_fractal].yMinMax[1];
+
+    // mandelbrot_coordinates
+    double xdelta = (maxx - minx) * xratio / R.original_width;
+    double ydelta = (maxy - miny) * yratio / R.original_height;
+    R.xdelta = xdelta;
+    R.ydelta = ydelta;
+
+    // after we pan we want to start here
+    // mandelbrot coordinates
+    dd_accumulate(R.xstart, R.xstart_lo,
+                  -((maxx - minx) / R.original_width) *
+                      (R.original_width / 2.0 - xcenter) * R.displayed_zoom);
+    double xstart = R.xstart;
+
+    dd_accumulate(R.ystart, R.ystart_lo,
+                  -((maxy - miny) / R.original_height) *
+                      (R.original_height / 2.0 - ycenter) * R.displayed_zoom);
+    double ystart = R.ystart;
+
+    std::cout << "pan: " << xcenter << " " << ycenter << " ";
+    std::cout << "  cdims: " << R.current_width << " " << R.current_height;
+    std::cout.precision(10);
+    std::cout << std::scientific << " starts: " << R.xstart << " "
+              << R.ystart << " ";
+    std::cout << "x range: " << std::scientific << xstart << " -> "
+              << xstart + (R.original_width - 1) * xdelta;
+    std::cout << "  y range: " << ystart << " -> "
+              << ystart + (R.original_height - 1) * ydelta << std::fixed
+              << std::endl;
+  }
+
+  // Start the frame for a pan from old. A pan by whole pixels leaves most of
+  // the previous frame valid: its finished rows are shifted over and the
+  // workers only compute the strips the pan uncovered.
+  void panFrame(const ReferenceFrame &old) {
+    // panFractal left a probabalistic view alone, keep its hits
+    if (FRAC[current_fractal].probabalistic == true) return;
+    bool was_running = workers.running();
+    workers.pause(true);  // nobody writes pixels while we move them
+    unsigned int old_gen = workers.generation();
+    unsigned int gen = workers.reset();
+
+    double fx = start_difference(R.xstart, R.xstart_lo, old.xstart,
+                                 old.xstart_lo) / R.xdelta;
+    double fy = start_difference(R.ystart, R.ystart_lo, old.ystart,
+                                 old.ystart_lo) / R.ydelta;
+    long dx = lround(fx);
+    long dy = lround(fy);
+    if ((R.xdelta == old.xdelta) && (R.ydelta == old.ydelta) &&
+        (std::abs(fx - dx) < 0.001) && (std::abs(fy - dy) < 0.001) &&
+        (labs(dx) < (long)view_width) && (labs(dy) < (long)view_height))
+      shiftPixels(dx, dy, old_gen, gen);
+
+    if (was_running) workers.resume();
+  }
+
+  // new pixel (i, j) is old pixel (i + dx, j + dy)
+  void shiftPixels(long dx, long dy, unsigned int old_gen, unsigned int gen) {
+    long w = view_width;
+    long h = view_height;
+    long is = std::max(0L, -dx);
+    long ie = std::min(w, w - dx);
+    // walk rows so a source row is read before it is overwritten
+    for (long n = 0; n < h; ++n) {
+      long j = (dy >= 0) ? n : h - 1 - n;
+      long src = j + dy;
+      kept[j] = KeptSpan{};
+      if ((src < 0) || (src >= h) || (row_generation[src] != old_gen))
+        continue;
+      std::memmove(&pixels[4 * (j * w + is)], &pixels[4 * (src * w + is + dx)],
+                   4 * (ie - is));
+      std::memmove(&escape_iters[j * w + is],
+                   &escape_iters[src * w + is + dx],
+                   sizeof(unsigned int) * (ie - is));
+      if (!escape_samples.empty())
+        std::memmove(&escape_samples[j * w + is],
+                     &escape_samples[src * w + is + dx],
+                     sizeof(EscapeSample) * (ie - is));
+      kept[j] = KeptSpan{gen, (unsigned int)is, (unsigned int)ie};
+    }
+    frame_replaced = true;  // upload the shifted frame in one go
+  }
+
+  void zoomFractal(double newzoom) {
+    if (FRAC[current_fractal].probabalistic == true) return;
+    calculateZoomWindow(newzoom);
+  }
+
+  void panFractal(double xcenter, double ycenter) {
+    if (FRAC[current_fractal].probabalistic == true) return;
+    calculatePanWindow(xcenter, ycenter);
+  }
+
+  // the finished frame as an image, for headless renders (no window)
+  sf::Image frameImage() {
+    const sf::Vector2u size(view_width, view_height);
+    if (FRAC[current_fractal].probabalistic == true) {
+      std::lock_guard<std::mutex> guard(thread_result_report_mutex);
+      showFrame(false);
+      rebuildImageFromHits();
+    } else {
+      setImagePixels(R.xstart, R.ystart, R.xdelta, R.ydelta);
+    }
+    return sf::Image(size, showing_histogram ? histogram_pixels.data()
+                                             : pixels.data());
+  }
+
+  void update(sf::Time elapsed) {
+    // draw image from latest data
+    if (FRAC[current_fractal].probabalistic == true) {
+      {
+        RenderProfiler::Scope timer(profiler, profiler.rebuild_ns);
+        std::lock_guard<std::mutex> guard(thread_result_report_mutex);
+        showFrame(false);
+        if (rebuildImageFromHits()) frame_replaced = true;
+      }
+    } else {
+      RenderProfiler::Scope timer(profiler, profiler.upload_ns);
+      setImagePixels(R.xstart, R.ystart, R.xdelta, R.ydelta);
+    }
+
+    // Update stats in Model to track how effective fractal threads,cuda are
+    gatherStats();
+    auto now = std::chrono::steady_clock::now();
+    unsigned long long samples_now = stats[current_fractal].total;
+    if ((now > stats[current_fractal].next_second_start) &&
+        (0 != (samples_now - stats[current_fractal].samples_last_second))) {
+      stats[current_fractal].samples_per_second =
+          (1000 * (samples_now - stats[current_fractal].samples_last_second)) /
+          (1000 + std::chrono::duration_cast<std::chrono::milliseconds>(
+                      now - stats[current_fractal].next_second_start)
+                      .count());
+      stats[current_fractal].next_second_start =
+          std::chrono::steady_clock::now() + std::chrono::milliseconds(1000);
+
+      // cout << stats[current_fractal].samples_per_second << " " <<
+      // (samples_now - stats[current_fractal].samples_last_second) << endl;
+
+      stats[current_fractal].samples_last_second = samples_now;
+    }
+
+    if (profiler.on()) {
+      RenderProfiler::Frame f =
+          profiler.take(stats[current_fractal].samples_per_second);
+      profile_text = profiler.hudText(f);
+      profiler.write(f);
+    }
+  }
+
+ public:
+  unsigned int current_fractal;
+  bool cuda_detected;
+  unsigned int view_width;
+  unsigned int view_height;
+  unsigned long long maxred = 0;
+  unsigned long long maxgreen = 0;
+  unsigned long long maxblue = 0;
+  unsigned long long hitsums = 0;
+
+  static const unsigned int STATS_FRACTALS = 16;
+  SampleStats stats[STATS_FRACTALS];  // indexed by fractal, see update()
+  SampleStats stats_baseline[STATS_FRACTALS];  // worker counts at the reset
+
+  unsigned int num_threads = 0;
+
+  // point to try next if not using random sampling (per thread)
+  std::vector<double> current_x;
+  std::vector<double> current_y;
+  std::vector<int> image_wraps;
+
+  // Per worker sample counters. Each worker only writes its own (cache line
+  // aligned) block and update() sums them into stats, so the hottest
+  // counters are neither lost to races nor bounced between cores.
+  struct alignas(64) WorkerStats {
+    std::atomic<unsigned long long> rejected[STATS_FRACTALS];
+    std::atomic<unsigned long long> in_set[STATS_FRACTALS];
+    std::atomic<unsigned long long> escaped_set[STATS_FRACTALS];
+    std::atomic<unsigned long long> total[STATS_FRACTALS];
+  };
+  std::unique_ptr<WorkerStats[]> worker_stats;
+
+  RenderProfiler profiler;
+  std::string profile_text;  // HUD, last profiler snapshot
+  double deltax;
+  double deltay;
+
+ private:
+  double original_view_width;
+  double original_view_height;
+  bool headless;
+
+  // RGBA frame buffer (row major, view_width x view_height) written by the
+  // workers and uploaded by the front end with no intermediate sf::Image
+  std::vector<std::uint8_t> pixels;
+  std::vector<std::uint8_t> histogram_pixels;  // HISTOGRAM coloring output
+  // what histogram_pixels was colored with, see setHistogramImagePixels
+  struct HistogramLook {
+    unsigned int iters_max = 0;
+    tinycolormap::ColormapType palette = tinycolormap::ColormapType::Parula;
+    bool reflect_palette = false;
+    double palette_offset = -1;
+    bool operator==(const HistogramLook &o) const {
+      return (iters_max == o.iters_max) && (palette == o.palette) &&
+             (reflect_palette == o.reflect_palette) &&
+             (palette_offset == o.palette_offset);
+    }
+  };
+  HistogramLook histogram_look;
+  std::vector<unsigned long long> histogram_counts;  // count_chunks x iters_max
+  std::vector<double> histogram_cdf;
+  // rows are uploaded in tiles of TILE_ROWS, only those written since the
+  // last upload
+  std::unique_ptr<std::atomic<bool>[]> tile_dirty;
+  unsigned int tile_count;
+  // shown frame is histogram_pixels (HISTOGRAM coloring), see showFrame
+  bool showing_histogram = false;
+  bool histogram_stale = false;  // colored before pixels were shown
+  bool frame_replaced = true;    // next upload is the whole frame
+  // frame generation each row of pixels was finished for
+  std::vector<unsigned int> row_generation;
+  // columns [start, end) of a row that a pan carried over, valid for
+  // frame generation gen only
+  struct KeptSpan {
+    unsigned int gen = 0;
+    unsigned int start = 0;
+    unsigned int end = 0;
+  };
+  std::vector<KeptSpan> kept;
+
+  // merged hits from threads
+  // tone map table of one buddhabrot channel, see rebuildImageFromHits
+  struct ToneLut {
+    ToneMap op = ToneMap::SQRT;
+    double gamma = 0;
+    double asinh = 0;
+    unsigned long long max_hits = 0;
+    std::vector<unsigned short> values;  // empty until first made
+  };
+  ToneLut tone_luts[3];
+  // what pixels were last tone mapped from, see rebuildImageFromHits
+  struct ToneLook {
+    unsigned long long hits_changes = ~0ull;
+    ToneMap op = ToneMap::SQRT;
+    double gamma = 0;
+    double asinh = 0;
+    bool operator==(const ToneLook &o) const {
+      return (hits_changes == o.hits_changes) && (op == o.op) &&
+             (gamma == o.gamma) && (asinh == o.asinh);
+    }
+  };
+  ToneLook tone_look;
+  unsigned long long hits_changes = 0;  // merges and resets (merge mutex)
+  std::vector<unsigned long long> tone_histograms;  // chunks x 3 x bins
+  std::vector<unsigned long long> tone_cumulative;
+  std::vector<unsigned char> tone_equalized[3];
+  std::vector<std::vector<unsigned long long>> redTrailHits;
+  std::vector<std::vector<unsigned long long>> greenTrailHits;
+  std::vector<std::vector<unsigned long long>> blueTrailHits;
+
+  // Non buddha fractals: escape iteration per pixel (row major) for
+  // histogram coloring
+  std::vector<unsigned int> escape_iters;
+
+  // tile cache (not headless): the samples each pixel was colored from,
+  // the frame generation each grid tile in the view was loaded for and how
+  // far each tile row of the grid got
+  std::vector<EscapeSample> escape_samples;
+  std::unique_ptr<std::atomic<unsigned int>[]> tile_loaded;
+  unsigned int cache_tiles_x = 0;
+  struct CacheRow {
+    unsigned int gen = 0;
+    unsigned int rows = 0;
+    double secs = 0;
+  };
+  std::vector<CacheRow> cache_rows;
+  std::mutex cache_rows_mutex;
+};  // FractalModel
+
+inline SavedFractal no_fractal{0, 1.0};
+
+// the current fractal and view as a key
+inline SavedFractal saved_from_model(std::shared_ptr<FractalModel> p_model) {
+  SavedFractal savef = no_fractal;
+  savef.version = FRACTAL_VERSION;
+  savef.valid = 1;
+  savef.current_fractal = p_model->current_fractal;
+  savef.current_power = FRAC[p_model->current_fractal].current_power;
+  for (unsigned int i = 0; i < 3; ++i)
+    savef.current_max_iters[i] =
+        FRAC[p_model->current_fractal].current_max_iters[i];
+  savef.current_zconst = FRAC[p_model->current_fractal].current_zconst;
+  savef.current_escape_r = FRAC[p_model->current_fractal].current_escape_r;
+  savef.poly = to_poly_coeffs(FRAC[p_model->current_fractal].current_poly);
+  savef.RF = R;
+  return savef;
+}
+
+// Convert version 1 keys (raw SavedFractal) to the tagged format once
+inline void migrate_legacy_keys() {
+  std::string legacy_dir = keys_location + legacy_key_version;
+  std::string dir = keys_location + key_version;
+  if (!fs::is_directory(legacy_dir)) return;
+  if (!fs::is_directory(dir)) fs::create_directory(dir);
+
+  for (auto &p : fs::directory_iterator(legacy_dir)) {
+    std::string stem = p.path().filename().string();
+    std::size_t ext = stem.rfind("." + legacy_key_version);
+    if (ext != std::string::npos) stem = stem.substr(0, ext);
+    std::string target = dir + separator + stem + "." + key_version;
+    if (fs::exists(target)) continue;
+
+    SavedFractal savef = no_fractal;
+    if (!read_key_file(p.path().string(), savef)) {
+      std::cout << "could not migrate key " << p.path() << std::endl;
+      continue;
+    }
+    write_key_file(target, savef);
+    std::cout << "migrated key " << p.path() << " -> " << target << std::endl;
+  }
+}
+
+/* CRC-32C (iSCSI) polynomial in reversed bit order. Used for key hashes. */
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+/* CRC-32 (Ethernet, ZIP, PNG) polynomial in reversed bit order. */
+const uint32_t CRC32_POLY = 0xedb88320;
+
+// slicing-by-8: t[k][b] is the crc of byte b followed by k zero bytes, so 8
+// input bytes are folded with 8 independent lookups instead of 64 shifts
+struct CrcTable {
+  uint32_t t[8][256];
+  explicit CrcTable(uint32_t poly) {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ poly : crc >> 1;
+      t[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+      for (int k = 1; k < 8; k++)
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+  }
+};
+
+inline uint32_t crc_slice8(const CrcTable &tab, uint32_t crc,
+                           const unsigned char *buf, size_t len) {
+  crc = ~crc;
+  while (len && ((uintptr_t)buf & 7)) {
+    crc = (crc >> 8) ^ tab.t[0][(crc ^ *buf++) & 0xff];
+    len--;
+  }
+  while (len >= 8) {
+    // byte order independent, no unaligned loads
+    uint32_t lo = crc ^ ((uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+                         (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24);
+    crc = tab.t[7][lo & 0xff] ^ tab.t[6][(lo >> 8) & 0xff] ^
+          tab.t[5][(lo >> 16) & 0xff] ^ tab.t[4][lo >> 24] ^
+          tab.t[3][buf[4]] ^ tab.t[2][buf[5]] ^ tab.t[1][buf[6]] ^
+          tab.t[0][buf[7]];
+    buf += 8;
+    len -= 8;
+  }
+  while (len--) crc = (crc >> 8) ^ tab.t[0][(crc ^ *buf++) & 0xff];
+  return ~crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SSE42_CRC 1
+// the crc32 instruction is CRC-32C, built without -msse4.2 and only called
+// when the cpu has it
+__attribute__((target("sse4.2"))) inline uint32_t crc32c_sse42(
+    uint32_t crc, const unsigned char *buf, size_t len) {
+  uint64_t c = ~crc;
+  while (len && ((uintptr_t)buf & 7)) {
+    c = __builtin_ia32_crc32qi((uint32_t)c, *buf++);
+    len--;
+  }
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, buf, 8);
+    c = __builtin_ia32_crc32di(c, v);
+    buf += 8;
+    len -= 8;
+  }
+  while (len--) c = __builtin_ia32_crc32qi((uint32_t)c, *buf++);
+  return ~(uint32_t)c;
+}
+inline bool cpu_has_sse42() { return __builtin_cpu_supports("sse4.2"); }
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define HAVE_SSE42_CRC 1
+inline uint32_t crc32c_sse42(uint32_t crc, const unsigned char *buf,
+                             size_t len) {
+  uint64_t c = ~crc;
+  while (len && ((uintptr_t)buf & 7)) {
+    c = _mm_crc32_u8((uint32_t)c, *buf++);
+    len--;
+  }
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, buf, 8);
+    c = _mm_crc32_u64(c, v);
+    buf += 8;
+    len -= 8;
+  }
+  while (len--) c = _mm_crc32_u8((uint32_t)c, *buf++);
+  return ~(uint32_t)c;
+}
+inline bool cpu_has_sse42() {
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;  // ecx bit 20: sse4.2
+}
+#endif
+
+inline uint32_t crc32c_table(uint32_t crc, const unsigned char *buf,
+                             size_t len) {
+  static const CrcTable tab(CRC32C_POLY);
+  return crc_slice8(tab, crc, buf, len);
+}
+
+// CRC-32C, hardware when available. Both paths give the same value.
+inline uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len) {
+  using CrcFn = uint32_t (*)(uint32_t, const unsigned char *, size_t);
+  static const CrcFn fn = []() -> CrcFn {
+#ifdef HAVE_SSE42_CRC
+    if (cpu_has_sse42()) return crc32c_sse42;
+#endif
+    return crc32c_table;
+  }();
+  return fn(crc, buf, len);
+}
+
+// CRC-32 as used by zip and png chunks
+inline uint32_t crc32(uint32_t crc, const unsigned char *buf, size_t len) {
+  static const CrcTable tab(CRC32_POLY);
+  return crc_slice8(tab, crc, buf, len);
+}
+
+// Saved keys by crc32c of their encoded bytes, so saving the same fractal
+// twice (easy when scripting thousands of animation keys) finds the existing
+// file instead of writing a copy. Built from the key directory on first use.
+// A crc hit is confirmed by comparing bytes, crc32 collides in big sets.
+class KeyIndex {
+ public:
+  // existing key file with exactly these bytes, or ""
+  std::string find(uint32_t crc, const std::string &bytes) {
+    scan();
+    auto range = by_crc.equal_range(crc);
+    for (auto it = range.first; it != range.second; ++it) {
+      std::string other;
+      if (read_file(it->second, other) && (other == bytes)) return it->second;
+    }
+    return "";
+  }
+  void add(uint32_t crc, const std::string &filename) {
+    scan();
+    by_crc.emplace(crc, filename);
+  }
+  size_t size() {
+    scan();
+    return by_crc.size();
+  }
+
+ private:
+  void scan() {
+    if (scanned) return;
+    scanned = true;
+    std::string dir = keys_location + key_version;
+    if (!fs::is_directory(dir)) return;
+    for (auto &p : fs::directory_iterator(dir)) {
+      std::string bytes;
+      if (!read_file(p.path().string(), bytes)) continue;
+      by_crc.emplace(
+          crc32c(0, reinterpret_cast<const unsigned char *>(bytes.data()),
+                 bytes.size()),
+          p.path().string());
+    }
+  }
+  static bool read_file(const std::string &filename, std::string &bytes) {
+    std::ifstream f(filename, std::ios::in | std::ios::binary);
+    if (!f) return false;
+    bytes.assign(std::istreambuf_iterator<char>(f),
+                 std::istreambuf_iterator<char>());
+    return true;
+  }
+  bool scanned = false;
+  std::unordered_multimap<uint32_t, std::string> by_crc;
+};
+inline KeyIndex key_index;
+
+// deepest wheel zoom, double-double (DOUBLE_DOUBLE_XDELTA) runs out here
+const double MIN_ZOOM = 1e-28;
+
+// respond to mouse wheel zoom
+inline double get_new_zoom(int delta) {
+  if (delta < 0) {
+    // zoom in
+    R.requested_zoom = R.requested_zoom * 0.90;
+    // cout << "zoom: " << current_zoom << endl;
+    if (R.requested_zoom < MIN_ZOOM) {
+      R.requested_zoom = 1.0;
+    }
+  } else {
+    // zoom out
+    R.requested_zoom = R.requested_zoom * 1.1;
+    // cout << "zoom: " << current_zoom << endl;
+
+    if (R.requested_zoom > 25.0) {
+      R.requested_zoom = 1.0;
+    }
+  }
+
+  return R.requested_zoom;
+}
+
+// the threads finished rendering the frame we want to save
+inline bool frameDone(std::shared_ptr<FractalModel> p_model) {
+  const SupportedFractal &f = FRAC[p_model->current_fractal];
+  if (f.probabalistic != true)
+    return workers.framePassed(p_model->num_threads, 1);
+  // in cuda mode only thread 0 samples
+  if ((f.cuda_mode == true) && (p_model->cuda_detected == true))
+    return workers.framePassed(1, 2);
+  return workers.framePassed(p_model->num_threads, 2);
+}
+
+// startup view and coloring for a width x height image
+inline void init_reference_frame(unsigned int width, unsigned int height) {
+  R.displayed_zoom = 1.0;
+  R.requested_zoom = 1.0;
+  R.current_height = height;
+  R.current_width = width;
+  R.original_height = height;
+  R.original_width = width;
+
+  R.color_cycle_size = 32;
+  R.palette =
+      tinycolormap::ColormapType::UF16;  // tinycolormap::ColormapType::Viridis;
+                                         // tinycolormap::ColormapType::UF16
+  R.color_algo = ColoringAlgo::MULTICYCLE;
+  R.image_loaded = false;
+
+  R.light_pos_r = 1;
+  R.light_pos_i = 0;
+  R.light_angle = 45;
+  R.light_height = 1.5;
+}
+
+// Headless benchmark:
+//   fractals_headless benchmark [results.json] [threads,threads,...]
+// renders a fixed set of views (no window, cpu threads, fixed sampling seed)
+// for every thread count and writes pixels/sec or samples/sec as json.
+struct BenchmarkCase {
+  std::string name;
+  std::string fractal;  // FRAC name
+  double center_x;
+  double center_y;
+  double zoom;             // R.requested_zoom, 1.0 is the whole fractal
+  unsigned int max_iters;  // 0 keeps the fractal default
+};
+
+inline std::vector<BenchmarkCase> benchmark_cases{
+    {"mandelbrot_interior", "Mandelbrot_1000", -0.5, 0.0, 1.0, 1000},
+    {"mandelbrot_deep_zoom", "Mandelbrot_1000", -0.743643887037151,
+     0.131825904205330, 0.00001, 5000},
+    {"mandelbrot_double_double", "Mandelbrot_1000", -0.743643887037151,
+     0.131825904205330, 1e-12, 5000},
+    {"julia", "Julia", 0.0, 0.0, 1.0, 0},
+    {"newton", "Newton_z6+z3-1", -0.5, 0.0, 1.0, 0},
+    {"nova", "Nova_z6+z3-1", -0.5, 0.0, 1.0, 0},
+    {"buddhabrot", "Buddhabrot_General", 0.0, 0.0, 1.0, 0},
+};
+
+const unsigned int BENCHMARK_REPEATS = 3;        // best of, escape time
+const unsigned int BENCHMARK_BUDDHA_PASSES = 1;  // batches of samples/thread
+const unsigned long long BENCHMARK_SEED = 20220904;
+
+// set up bc on the paused workers, false if its fractal doesnt exist
+inline bool setup_benchmark_case(std::shared_ptr<FractalModel> p_model,
+                                 const BenchmarkCase &bc) {
+  unsigned int ix = 0;
+  while ((ix < FRAC.size()) && (FRAC[ix].name != bc.fractal)) ++ix;
+  if (ix == FRAC.size()) return false;
+
+  p_model->current_fractal = ix;
+  p_model->reset_fractal_params();
+  if (bc.max_iters != 0) FRAC[ix].current_max_iters[0] = bc.max_iters;
+  R.random_sample = true;
+  p_model->reset_fractal_and_reference_frame();
+  p_model->zoomFractal(bc.zoom);
+  p_model->panFractal((bc.center_x - R.xstart) / R.xdelta,
+                      (bc.center_y - R.ystart) / R.ydelta);
+  return true;
+}
+
+inline int run_benchmark(int argc, char **argv) {
+  std::string results_name{"benchmark_results.json"};
+  if (argc > 2) results_name = argv[2];
+
+  unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned int> thread_counts;
+  if (argc > 3) {
+    for (int t : parse_cpu_list(argv[3]))
+      if (t > 0) thread_counts.push_back(t);
+  } else {
+    for (unsigned int t = 1; t < hw; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(hw);
+  }
+
+  init_reference_frame(IMAGE_WIDTH, IMAGE_HEIGHT);
+  auto p_model =
+      std::make_shared<FractalModel>(IMAGE_WIDTH, IMAGE_HEIGHT, true);
+  p_model->cuda_detected = false;  // measure the cpu threads
+  sample_seed = BENCHMARK_SEED;
+  worker_cpus = worker_cpu_order();
+
+  std::ofstream results(results_name, std::ios::out | std::ios::trunc);
+  results << "{\"width\": " << IMAGE_WIDTH << ", \"height\": " << IMAGE_HEIGHT
+          << ", \"hardware_threads\": " << hw << ", \"seed\": " << sample_seed
+          << ", \"results\": [";
+  bool first = true;
+
+  for (unsigned int num_threads : thread_counts) {
+    p_model->setThreads(num_threads);
+    workers.setThreads(num_threads);
+    std::vector<std::thread> threads;
+    for (unsigned int tix = 0; tix < num_threads; ++tix)
+      threads.emplace_back(&FractalModel::fractal_thread, p_model, tix);
+
+    for (auto &bc : benchmark_cases) {
+      workers.pause(true);
+      if (!setup_benchmark_case(p_model, bc)) {
+        std::cout << "benchmark: no fractal " << bc.fractal << std::endl;
+        continue;
+      }
+      bool sampled = FRAC[p_model->current_fractal].probabalistic;
+      unsigned int passes = sampled ? BENCHMARK_BUDDHA_PASSES : 1;
+      unsigned int repeats = sampled ? 1 : BENCHMARK_REPEATS;
+
+      double best = 0;
+      unsigned long long work = 0;
+      for (unsigned int r = 0; r < repeats; ++r) {
+        p_model->gatherStats();
+        unsigned long long samples_before =
+            p_model->stats[p_model->current_fractal].total;
+        auto start = std::chrono::steady_clock::now();
+        workers.reset();
+        workers.resume();
+        while (!workers.framePassed(num_threads, passes))
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+        double secs = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+        workers.pause(true);
+        p_model->gatherStats();
+        unsigned long long done =
+            sampled ? p_model->stats[p_model->current_fractal].total -
+                          samples_before
+                    : (unsigned long long)IMAGE_WIDTH * IMAGE_HEIGHT;
+        if ((r == 0) || (secs < best)) {
+          best = secs;
+          work = done;
+        }
+      }
+
+      double rate = (best > 0) ? work / best : 0.0;
+      std::cout << "benchmark " << bc.name << " threads " << num_threads
+                << ": " << best << " s, " << rate
+                << (sampled ? " samples/s" : " pixels/s") << " ("
+                << rate / num_threads << " per thread)" << std::endl;
+
+      results << (first ? "" : ",") << "\n  {\"case\": \"" << bc.name
+              << "\", \"fractal\": \"" << bc.fractal
+              << "\", \"threads\": " << num_threads
+              << ", \"seconds\": " << best << ", \"unit\": \""
+              << (sampled ? "samples" : "pixels") << "\", \"work\": " << work
+              << ", \"per_second\": " << rate
+              << ", \"per_second_per_thread\": " << rate / num_threads << "}";
+      first = false;
+    }
+
+    workers.terminate();
+    for (auto &t : threads) t.join();
+  }
+  results << "\n]}" << std::endl;
+  std::cout << "benchmark results in " << results_name << std::endl;
+  return 0;
+}
+
+// Keyframe animation:
+//   fractals_headless animate <frames> <output prefix> <key> <key> ...
+// renders frames images moving through the keys in one process (threads and
+// buffers are reused) to <output prefix>00000.png, 00001.png, ...
+// An output prefix ending in .y4m, or - for stdout, streams the frames as
+// one uncompressed video instead (see Y4MWriter).
+// Zoom is interpolated in log space and the center so that the point the
+// zoom is heading for stays put on screen, power, zconst, escape radius,
+// iterations, lighting and palette offset linearly. Everything else (the
+// fractal, palette, coloring) comes from the key starting the segment.
+const unsigned int ANIMATE_FRAME_DIGITS = 5;
+
+// center (fractal coordinates) and zoom a key shows once loaded, see
+// LoadProvidedKey: pan to the center of displayed_zoom, then zoom
+struct KeyView {
+  DoubleDouble cx;
+  DoubleDouble cy;
+  double zoom;
+};
+
+inline KeyView key_view(const SavedFractal &sf) {
+  const SupportedFractal &f = FRAC[sf.current_fractal];
+  double w = f.xMinMax[1] - f.xMinMax[0];
+  double h = f.yMinMax[1] - f.yMinMax[0];
+  double zoom = (sf.RF.requested_zoom > 0) ? sf.RF.requested_zoom : 1.0;
+  return KeyView{dd_add(DoubleDouble{sf.RF.xstart, sf.RF.xstart_lo},
+                        w * sf.RF.displayed_zoom / 2.0),
+                 dd_add(DoubleDouble{sf.RF.ystart, sf.RF.ystart_lo},
+                        h * sf.RF.displayed_zoom / 2.0),
+                 zoom};
+}
+
+inline double key_lerp(double a, double b, double u) { return a + (b - a) * u; }
+
+// the key u of the way from a to b, with its view set up for a width x
+// height image
+inline SavedFractal interpolate_keys(const SavedFractal &a,
+                                     const SavedFractal &b, double u,
+                                     unsigned int width,
+                                     unsigned int height) {
+  SavedFractal s = a;
+  if (a.current_fractal == b.current_fractal) {
+    s.current_power = key_lerp(a.current_power, b.current_power, u);
+    s.current_zconst = std::complex<double>(
+        key_lerp(a.current_zconst.real(), b.current_zconst.real(), u),
+        key_lerp(a.current_zconst.imag(), b.current_zconst.imag(), u));
+    s.current_escape_r = key_lerp(a.current_escape_r, b.current_escape_r, u);
+    for (int k = 0; k < 3; ++k)
+      s.current_max_iters[k] = (unsigned int)lround(
+          key_lerp(a.current_max_iters[k], b.current_max_iters[k], u));
+    // same degree: the roots move smoothly with the coefficients
+    if (a.poly.count == b.poly.count)
+      for (unsigned int k = 0; k < a.poly.count; ++k)
+        s.poly.c[k] = a.poly.c[k] + (b.poly.c[k] - a.poly.c[k]) * u;
+  }
+  s.RF.palette_offset = key_lerp(a.RF.palette_offset, b.RF.palette_offset, u);
+  s.RF.light_pos_r = key_lerp(a.RF.light_pos_r, b.RF.light_pos_r, u);
+  s.RF.light_pos_i = key_lerp(a.RF.light_pos_i, b.RF.light_pos_i, u);
+  s.RF.light_angle = key_lerp(a.RF.light_angle, b.RF.light_angle, u);
+  s.RF.light_height = key_lerp(a.RF.light_height, b.RF.light_height, u);
+
+  KeyView va = key_view(a);
+  KeyView vb = key_view(b);
+  double zoom = va.zoom * pow(vb.zoom / va.zoom, u);
+  // a zoom about a fixed point moves the center in proportion to the
+  // change in scale
+  double w = u;
+  if (std::abs(va.zoom - vb.zoom) > 1e-12 * va.zoom)
+    w = (va.zoom - zoom) / (va.zoom - vb.zoom);
+  DoubleDouble cx = dd_add(va.cx, dd_sub(vb.cx, va.cx).hi * w);
+  DoubleDouble cy = dd_add(va.cy, dd_sub(vb.cy, va.cy).hi * w);
+
+  const SupportedFractal &f = FRAC[s.current_fractal];
+  double fw = f.xMinMax[1] - f.xMinMax[0];
+  double fh = f.yMinMax[1] - f.yMinMax[0];
+  s.RF.original_width = width;
+  s.RF.original_height = height;
+  s.RF.displayed_zoom = zoom;
+  s.RF.requested_zoom = zoom;
+  s.RF.xdelta = fw * zoom / width;
+  s.RF.ydelta = fh * zoom / height;
+  DoubleDouble xstart = dd_add(cx, -fw * zoom / 2.0);
+  DoubleDouble ystart = dd_add(cy, -fh * zoom / 2.0);
+  s.RF.xstart = xstart.hi;
+  s.RF.xstart_lo = xstart.lo;
+  s.RF.ystart = ystart.hi;
+  s.RF.ystart_lo = ystart.lo;
+  s.RF.current_width = zoom * width;
+  s.RF.current_height = zoom * height;
+  return s;
+}
+
+// make sf the current fractal and view (workers paused)
+inline void apply_key(std::shared_ptr<FractalModel> p_model,
+                      const SavedFractal &sf) {
+  p_model->current_fractal = sf.current_fractal;
+  // buddhabrots accumulate, start each frame from no hits
+  if (FRAC[sf.current_fractal].probabalistic == true)
+    p_model->reset_fractal_and_reference_frame();
+  FRAC[sf.current_fractal].current_power = sf.current_power;
+  FRAC[sf.current_fractal].current_max_iters = {sf.current_max_iters[0],
+                                                 sf.current_max_iters[1],
+                                                 sf.current_max_iters[2]};
+  FRAC[sf.current_fractal].current_zconst = sf.current_zconst;
+  FRAC[sf.current_fractal].current_escape_r = sf.current_escape_r;
+  p_model->setPolynomial(from_poly_coeffs(sf.poly));
+  R = sf.RF;
+}
+
+// Zoom movie with temporal reuse:
+//   fractals_headless zoom_movie <frames> <output prefix> <key> <key> ...
+// The same frames as animate, but only keyframes are rendered: at
+// ZOOM_OVERSAMPLE times the output resolution, then this frame and the
+// ones after it are resampled from the keyframe while they lie inside it
+// and still get ZOOM_MIN_DENSITY keyframe pixels per output pixel. Zooming
+// in by 1-2% a frame one keyframe serves dozens of frames. Anything but the
+// view (power, palette, ...) changing needs a new keyframe, zooming out
+// gets no reuse.
+const unsigned int ZOOM_OVERSAMPLE = 2;
+const double ZOOM_MIN_DENSITY = 1.0;
+
+// sf's view (same center and zoom) for a width x height image
+inline SavedFractal view_at_size(SavedFractal sf, unsigned int width,
+                                 unsigned int height) {
+  sf.RF.xdelta *= sf.RF.original_width / width;
+  sf.RF.ydelta *= sf.RF.original_height / height;
+  sf.RF.original_width = width;
+  sf.RF.original_height = height;
+  sf.RF.current_width = sf.RF.displayed_zoom * width;
+  sf.RF.current_height = sf.RF.displayed_zoom * height;
+  return sf;
+}
+
+// everything but the view and iterations match
+inline bool same_look(const SavedFractal &a, const SavedFractal &b) {
+  return (a.current_fractal == b.current_fractal) &&
+         (a.current_power == b.current_power) &&
+         (a.current_zconst == b.current_zconst) &&
+         (a.current_escape_r == b.current_escape_r) &&
+         (from_poly_coeffs(a.poly) == from_poly_coeffs(b.poly)) &&
+         (a.RF.color_algo == b.RF.color_algo) &&
+         (a.RF.color_cycle_size == b.RF.color_cycle_size) &&
+         (a.RF.palette == b.RF.palette) &&
+         (a.RF.reflect_palette == b.RF.reflect_palette) &&
+         (a.RF.palette_offset == b.RF.palette_offset) &&
+         (a.RF.light_pos_r == b.RF.light_pos_r) &&
+         (a.RF.light_pos_i == b.RF.light_pos_i) &&
+         (a.RF.light_angle == b.RF.light_angle) &&
+         (a.RF.light_height == b.RF.light_height);
+}
+
+// frame can be resampled from keyframe
+inline bool reusable(const SavedFractal &keyframe, const SavedFractal &frame) {
+  const ReferenceFrame &k = keyframe.RF;
+  const ReferenceFrame &f = frame.RF;
+  if (!same_look(keyframe, frame)) return false;
+  if (f.xdelta / k.xdelta < ZOOM_MIN_DENSITY) return false;
+  // a little slack for rounding in the view math
+  double sx = 1e-6 * k.xdelta;
+  double sy = 1e-6 * k.ydelta;
+  // frame start relative to the keyframe start
+  double fx = start_difference(f.xstart, f.xstart_lo, k.xstart, k.xstart_lo);
+  double fy = start_difference(f.ystart, f.ystart_lo, k.ystart, k.ystart_lo);
+  return (fx >= -sx) && (fy >= -sy) &&
+         (fx + (f.original_width - 1) * f.xdelta <=
+          (k.original_width - 1) * k.xdelta + sx) &&
+         (fy + (f.original_height - 1) * f.ydelta <=
+          (k.original_height - 1) * k.ydelta + sy);
+}
+
+// Output frame `to` from the keyframe image `from` (both RGBA). Each output
+// pixel averages 2x2 bilinear samples over its footprint in the keyframe,
+// which is 1 to ZOOM_OVERSAMPLE keyframe pixels across.
+inline void resample_frame(const std::uint8_t *key, const ReferenceFrame &from,
+                           std::vector<std::uint8_t> &out,
+                           const ReferenceFrame &to) {
+  const unsigned int kw = (unsigned int)from.original_width;
+  const unsigned int kh = (unsigned int)from.original_height;
+  const unsigned int w = (unsigned int)to.original_width;
+  const unsigned int h = (unsigned int)to.original_height;
+  out.assign((size_t)4 * w * h, 255);
+  const double sx = to.xdelta / from.xdelta;  // keyframe pixels per pixel
+  const double sy = to.ydelta / from.ydelta;
+  const double x0 = start_difference(to.xstart, to.xstart_lo, from.xstart,
+                                     from.xstart_lo) / from.xdelta;
+  const double y0 = start_difference(to.ystart, to.ystart_lo, from.ystart,
+                                     from.ystart_lo) / from.ydelta;
+
+  auto bilinear = [&](double u, double v, int c) {
+    u = std::min(std::max(u, 0.0), kw - 1.0);
+    v = std::min(std::max(v, 0.0), kh - 1.0);
+    unsigned int i = std::min((unsigned int)u, kw - 2);
+    unsigned int j = std::min((unsigned int)v, kh - 2);
+    double fu = u - i;
+    double fv = v - j;
+    const std::uint8_t *p = key + 4 * ((size_t)j * kw + i) + c;
+    const size_t down = (size_t)4 * kw;
+    return (1 - fv) * ((1 - fu) * p[0] + fu * p[4]) +
+           fv * ((1 - fu) * p[down] + fu * p[down + 4]);
+  };
+
+  unsigned int chunks = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> helpers;
+  for (unsigned int c = 0; c < chunks; ++c) {
+    helpers.emplace_back([&, c]() {
+      for (unsigned int j = c * h / chunks; j < (c + 1) * h / chunks; ++j) {
+        double v = y0 + j * sy;
+        for (unsigned int i = 0; i < w; ++i) {
+          double u = x0 + i * sx;
+          std::uint8_t *o = &out[4 * ((size_t)j * w + i)];
+          for (int ch = 0; ch < 3; ++ch) {
+            double sum = bilinear(u - sx / 4, v - sy / 4, ch) +
+                         bilinear(u + sx / 4, v - sy / 4, ch) +
+                         bilinear(u - sx / 4, v + sy / 4, ch) +
+                         bilinear(u + sx / 4, v + sy / 4, ch);
+            o[ch] = (std::uint8_t)std::lround(sum / 4);
+          }
+        }
+      }
+    });
+  }
+  for (auto &t : helpers) t.join();
+}
+
+// render sf on the workers and wait for the frame
+inline void render_key(std::shared_ptr<FractalModel> p_model,
+                       const SavedFractal &sf) {
+  workers.pause(true);
+  apply_key(p_model, sf);
+  workers.reset();
+  workers.resume();
+  while (!frameDone(p_model))
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  workers.pause(true);
+}
+
+// Uncompressed YUV4MPEG2 video (4:2:0, BT.601 studio range) so a video
+// encoder reads the frames straight from a file or pipe with no pngs, e.g.
+//   fractals_headless animate 300 - a.key b.key | ffmpeg -i - zoom.mp4
+const unsigned int Y4M_FPS = 30;
+
+class Y4MWriter {
+ public:
+  ~Y4MWriter() { close(); }
+
+  // target: a file name or - for stdout
+  bool open(const std::string &target, unsigned int width,
+            unsigned int height) {
+    w = width;
+    h = height;
+    if (target == "-") {
+#ifdef _WIN32
+      _setmode(_fileno(stdout), _O_BINARY);
+#else
+      // an encoder that quits closes the pipe: fail the write instead of
+      // dying on SIGPIPE, so run_animation stops and cleans up
+      signal(SIGPIPE, SIG_IGN);
+#endif
+      f = stdout;
+    } else {
+      f = fopen(target.c_str(), "wb");
+      if (f == nullptr) return false;
+    }
+    // C420jpeg: chroma sited between the 2x2 pixels it averages
+    std::string header = "YUV4MPEG2 W" + std::to_string(w) + " H" +
+                         std::to_string(h) + " F" + std::to_string(Y4M_FPS) +
+                         ":1 Ip A1:1 C420jpeg\n";
+    return fwrite(header.data(), 1, header.size(), f) == header.size();
+  }
+
+  // one RGBA frame of width x height
+  bool write(const std::uint8_t *rgba) {
+    const unsigned int cw = (w + 1) / 2;
+    const unsigned int ch = (h + 1) / 2;
+    frame.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    std::uint8_t *y_plane = frame.data();
+    std::uint8_t *u_plane = y_plane + (size_t)w * h;
+    std::uint8_t *v_plane = u_plane + (size_t)cw * ch;
+
+    for (unsigned int j = 0; j < h; ++j) {
+      const std::uint8_t *p = rgba + (size_t)4 * w * j;
+      for (unsigned int i = 0; i < w; ++i, p += 4)
+        y_plane[(size_t)w * j + i] =
+            (std::uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) +
+                           16);
+    }
+    // chroma of the average color of each 2x2 block (clamped at odd edges)
+    for (unsigned int cj = 0; cj < ch; ++cj) {
+      for (unsigned int ci = 0; ci < cw; ++ci) {
+        int r = 0, g = 0, b = 0, n = 0;
+        for (unsigned int j = 2 * cj; j < std::min(2 * cj + 2, h); ++j)
+          for (unsigned int i = 2 * ci; i < std::min(2 * ci + 2, w); ++i) {
+            const std::uint8_t *p = rgba + 4 * ((size_t)w * j + i);
+            r += p[0];
+            g += p[1];
+            b += p[2];
+            n++;
+          }
+        r /= n;
+        g /= n;
+        b /= n;
+        u_plane[(size_t)cw * cj + ci] =
+            (std::uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v_plane[(size_t)cw * cj + ci] =
+            (std::uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+      }
+    }
+
+    static const char marker[] = "FRAME\n";
+    if (fwrite(marker, 1, sizeof(marker) - 1, f) != sizeof(marker) - 1)
+      return false;
+    return fwrite(frame.data(), 1, frame.size(), f) == frame.size();
+  }
+
+  void close() {
+    if (f == nullptr) return;
+    if (f == stdout)
+      fflush(f);
+    else
+      fclose(f);
+    f = nullptr;
+  }
+
+ private:
+  FILE *f = nullptr;
+  unsigned int w = 0;
+  unsigned int h = 0;
+  std::vector<std::uint8_t> frame;  // Y, U and V planes
+};
+
+// animate and zoom_movie
+inline int run_animation(int argc, char **argv) {
+  std::string mode = argv[1];
+  if (argc < 6) {
+    std::cout << "usage: " << argv[0] << " " << mode
+              << " <frames> <output prefix> <key> <key> [<key> ...]"
+              << std::endl;
+    return -1;
+  }
+  bool reuse = (mode == "zoom_movie");
+  unsigned int frames = (unsigned int)std::max(2, atoi(argv[2]));
+  std::string prefix = argv[3];
+  const bool to_stdout = (prefix == "-");
+  const bool y4m =
+      to_stdout || ((prefix.size() > 4) &&
+                    (prefix.compare(prefix.size() - 4, 4, ".y4m") == 0));
+  // stdout carries the video, so the messages go to stderr until we return
+  struct CoutToStderr {
+    std::streambuf *saved;
+    ~CoutToStderr() {
+      if (saved) std::cout.rdbuf(saved);
+    }
+  } cout_to_stderr{to_stdout ? std::cout.rdbuf(std::cerr.rdbuf()) : nullptr};
+
+  // the model renders keyframes, oversized for zoom_movie
+  unsigned int scale = reuse ? ZOOM_OVERSAMPLE : 1;
+  unsigned int kw = IMAGE_WIDTH * scale;
+  unsigned int kh = IMAGE_HEIGHT * scale;
+  init_reference_frame(kw, kh);
+  auto p_model = std::make_shared<FractalModel>(kw, kh, true);
+  p_model->cuda_detected = false;
+
+  std::vector<SavedFractal> keys;
+  for (int a = 4; a < argc; ++a) {
+    SavedFractal sf = saved_from_model(p_model);
+    if (!read_key_file(argv[a], sf)) {
+      std::cout << "unreadable fractal key: " << argv[a] << std::endl;
+      return -1;
+    }
+    if (reuse && FRAC[sf.current_fractal].probabalistic) {
+      std::cout << mode << " needs escape time fractals, " << argv[a] << " is "
+                << FRAC[sf.current_fractal].name << " (use animate)"
+                << std::endl;
+      return -1;
+    }
+    keys.push_back(sf);
+  }
+
+  // all the frames up front so a keyframe knows which frames it serves
+  std::vector<SavedFractal> shots;
+  for (unsigned int n = 0; n < frames; ++n) {
+    double t = (double)n * (keys.size() - 1) / (frames - 1);
+    size_t k = std::min((size_t)t, keys.size() - 2);
+    shots.push_back(interpolate_keys(keys[k], keys[k + 1], t - k, IMAGE_WIDTH,
+                                     IMAGE_HEIGHT));
+  }
+
+  fs::path dir = fs::path(prefix).parent_path();
+  if (!dir.empty()) fs::create_directories(dir);
+  Y4MWriter video;
+  if (y4m && !video.open(prefix, IMAGE_WIDTH, IMAGE_HEIGHT)) {
+    std::cout << "could not write " << prefix << std::endl;
+    return -1;
+  }
+
+  unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  p_model->setThreads(num_threads);
+  workers.setThreads(num_threads);
+  worker_cpus = worker_cpu_order();
+  std::vector<std::thread> threads;
+  for (unsigned int tix = 0; tix < num_threads; ++tix)
+    threads.emplace_back(&FractalModel::fractal_thread, p_model, tix);
+
+  auto start = std::chrono::steady_clock::now();
+  unsigned int rendered = 0;
+  SavedFractal keyframe = shots[0];
+  unsigned int keyframe_last = 0;  // last frame keyframe serves
+  sf::Image key_image;
+  std::vector<std::uint8_t> out;
+  for (unsigned int n = 0; n < frames; ++n) {
+    std::string number = std::to_string(n);
+    if (number.size() < ANIMATE_FRAME_DIGITS)
+      number.insert(0, ANIMATE_FRAME_DIGITS - number.size(), '0');
+    std::string filename = y4m ? prefix : prefix + number + ".png";
+    bool ok = true;
+
+    if (!reuse) {
+      render_key(p_model, shots[n]);
+      rendered++;
+      if (y4m)
+        ok = video.write(p_model->frameImage().getPixelsPtr());
+      else
+        exporter.submit(filename, p_model->frameImage());
+    } else {
+      if ((n == 0) || (n > keyframe_last)) {
+        keyframe = view_at_size(shots[n], kw, kh);
+        keyframe_last = n;
+        while ((keyframe_last + 1 < frames) &&
+               reusable(keyframe, shots[keyframe_last + 1]))
+          keyframe_last++;
+        // enough iterations for the deepest frame it serves
+        for (unsigned int m = n; m <= keyframe_last; ++m)
+          for (int k = 0; k < 3; ++k)
+            keyframe.current_max_iters[k] = std::max(
+                keyframe.current_max_iters[k], shots[m].current_max_iters[k]);
+        render_key(p_model, keyframe);
+        rendered++;
+        key_image = p_model->frameImage();
+      }
+      resample_frame(key_image.getPixelsPtr(), keyframe.RF, out, shots[n].RF);
+      if (y4m)
+        ok = video.write(out.data());
+      else
+        exporter.submit(filename,
+                        sf::Image(sf::Vector2u(IMAGE_WIDTH, IMAGE_HEIGHT),
+                                  out.data()));
+    }
+    if (!ok) {
+      // the encoder reading the pipe went away, no point rendering on
+      std::cout << "could not write frame " << n << " to " << filename
+                << std::endl;
+      break;
+    }
+    std::cout << "frame " << n + 1 << "/" << frames << " zoom "
+              << shots[n].RF.displayed_zoom << " " << filename << std::endl;
+  }
+  video.close();
+  exporter.flush();  // the time includes writing the last frames
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  std::cout << frames << " frames (" << rendered << " rendered) in " << secs
+            << " s" << std::endl;
+
+  workers.terminate();
+  for (auto &t : threads) t.join();
+  return 0;
+}
+
+// Poster:
+//   fractals_headless poster <width> <height> <key> <output.png>
+// renders the key's view at any size (e.g. 32768 x 18432 for print) in
+// strips of rows, each strip goes to the png as soon as it is done, so memory
+// is about POSTER_STRIP_BYTES whatever the size. Escape time fractals only
+// (buddhabrot hits cover the whole image), histogram coloring is replaced by
+// multicycle (each strip would equalize on its own and show seams).
+const std::size_t POSTER_STRIP_BYTES = 64ull << 20;
+// model pixels, escape iterations, histogram pixels and the strip image copy
+const unsigned int POSTER_BYTES_PER_PIXEL = 16;
+
+// Writes an RGB png a few rows at a time. The image data is one zlib stream
+// of stored (uncompressed) deflate blocks, which needs no zlib and keeps
+// nothing but the current rows in memory. Each addRows is one IDAT chunk.
+// Recompress with any png optimizer if size matters.
+class PngStreamWriter {
+ public:
+  ~PngStreamWriter() {
+    if (f != nullptr) fclose(f);
+  }
+
+  bool open(const std::string &filename, unsigned int width,
+            unsigned int height) {
+    w = width;
+    h = height;
+    f = fopen(filename.c_str(), "wb");
+    if (f == nullptr) return false;
+    static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+    std::string ihdr;
+    append_be32(ihdr, w);
+    append_be32(ihdr, h);
+    ihdr += {8, 2, 0, 0, 0};  // 8 bit RGB, deflate, no filter, no interlace
+    return (fwrite(signature, 1, 8, f) == 8) && chunk("IHDR", ihdr);
+  }
+
+  // the next rows, RGBA (alpha is dropped)
+  bool addRows(const std::uint8_t *rgba, unsigned int rows) {
+    std::string raw;
+    raw.reserve((size_t)rows * (1 + 3 * (size_t)w));
+    for (unsigned int j = 0; j < rows; ++j) {
+      raw += '\0';  // filter: none
+      const std::uint8_t *p = rgba + (size_t)4 * w * j;
+      for (unsigned int i = 0; i < w; ++i, p += 4)
+        raw.append(reinterpret_cast<const char *>(p), 3);
+    }
+    adler32(raw);
+    rows_written += rows;
+    const bool last = (rows_written >= h);
+
+    std::string idat;
+    if (!started) idat += {0x78, 0x01};  // zlib: deflate, 32K window
+    started = true;
+    for (size_t pos = 0; pos < raw.size(); pos += 65535) {
+      std::uint16_t len =
+          (std::uint16_t)std::min<size_t>(65535, raw.size() - pos);
+      idat += (char)((last && (pos + len == raw.size())) ? 1 : 0);  // BFINAL
+      idat += {(char)(len & 0xff), (char)(len >> 8), (char)(~len & 0xff),
+               (char)((~len >> 8) & 0xff)};
+      idat.append(raw, pos, len);
+    }
+    if (last) append_be32(idat, (adler_b << 16) | adler_a);
+    return chunk("IDAT", idat);
+  }
+
+  // false unless every row was written
+  bool close() {
+    if (f == nullptr) return false;
+    bool ok = (rows_written == h) && chunk("IEND", "");
+    ok = (fclose(f) == 0) && ok;
+    f = nullptr;
+    return ok;
+  }
+
+ private:
+  static void append_be32(std::string &s, std::uint32_t v) {
+    s += {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+  }
+
+  bool chunk(const char *type, const std::string &data) {
+    std::string head;
+    append_be32(head, (std::uint32_t)data.size());
+    head.append(type, 4);
+    uint32_t crc = crc32(
+        0, reinterpret_cast<const unsigned char *>(head.data() + 4), 4);
+    crc = crc32(crc, reinterpret_cast<const unsigned char *>(data.data()),
+                data.size());
+    std::string tail;
+    append_be32(tail, crc);
+    return (fwrite(head.data(), 1, head.size(), f) == head.size()) &&
+           (fwrite(data.data(), 1, data.size(), f) == data.size()) &&
+           (fwrite(tail.data(), 1, tail.size(), f) == tail.size());
+  }
+
+  void adler32(const std::string &raw) {
+    // 5552 bytes is the most that can be summed before b overflows
+    for (size_t pos = 0; pos < raw.size(); pos += 5552) {
+      size_t end = std::min(raw.size(), pos + 5552);
+      for (size_t k = pos; k < end; ++k) {
+        adler_a += (unsigned char)raw[k];
+        adler_b += adler_a;
+      }
+      adler_a %= 65521;
+      adler_b %= 65521;
+    }
+  }
+
+  FILE *f = nullptr;
+  unsigned int w = 0;
+  unsigned int h = 0;
+  unsigned int rows_written = 0;
+  bool started = false;
+  std::uint32_t adler_a = 1;
+  std::uint32_t adler_b = 0;
+};
+
+inline int run_poster(int argc, char **argv) {
+  if (argc < 6) {
+    std::cout << "usage: " << argv[0]
+              << " poster <width> <height> <key> <output.png>" << std::endl;
+    return -1;
+  }
+  unsigned int width = (unsigned int)std::max(1, atoi(argv[2]));
+  unsigned int height = (unsigned int)std::max(1, atoi(argv[3]));
+  std::string filename = argv[5];
+
+  unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  // at least a row per thread
+  std::size_t fit =
+      POSTER_STRIP_BYTES / ((std::size_t)POSTER_BYTES_PER_PIXEL * width);
+  unsigned int strip_rows = (unsigned int)std::min<std::size_t>(
+      height, std::max<std::size_t>(num_threads, fit));
+  init_reference_frame(width, strip_rows);
+  auto p_model = std::make_shared<FractalModel>(width, strip_rows, true);
+  p_model->cuda_detected = false;
+
+  SavedFractal key = saved_from_model(p_model);
+  if (!read_key_file(argv[4], key)) {
+    std::cout << "unreadable fractal key: " << argv[4] << std::endl;
+    return -1;
+  }
+  if (FRAC[key.current_fractal].probabalistic) {
+    std::cout << "poster needs escape time fractals, " << argv[4] << " is "
+              << FRAC[key.current_fractal].name << std::endl;
+    return -1;
+  }
+  if (key.RF.color_algo == ColoringAlgo::HISTOGRAM) {
+    std::cout << "histogram coloring is per strip, using multicycle"
+              << std::endl;
+    key.RF.color_algo = ColoringAlgo::MULTICYCLE;
+  }
+  if (std::abs(key.RF.original_width / key.RF.original_height -
+               (double)width / height) > 0.01 * width / height)
+    std::cout << "note: " << width << "x" << height
+              << " has another aspect ratio than the key, the view is stretched"
+              << std::endl;
+  const SavedFractal view = view_at_size(key, width, height);
+
+  fs::path dir = fs::path(filename).parent_path();
+  if (!dir.empty()) fs::create_directories(dir);
+  PngStreamWriter png;
+  if (!png.open(filename, width, height)) {
+    std::cout << "could not write " << filename << std::endl;
+    return -1;
+  }
+
+  p_model->setThreads(num_threads);
+  workers.setThreads(num_threads);
+  worker_cpus = worker_cpu_order();
+  std::vector<std::thread> threads;
+  for (unsigned int tix = 0; tix < num_threads; ++tix)
+    threads.emplace_back(&FractalModel::fractal_thread, p_model, tix);
+
+  std::cout << "poster " << width << "x" << height << " in strips of "
+            << strip_rows << " rows" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  bool ok = true;
+  for (unsigned int y0 = 0; ok && (y0 < height); y0 += strip_rows) {
+    // the poster's view, starting y0 rows down (double-double origin)
+    unsigned int rows = std::min(strip_rows, height - y0);
+    SavedFractal strip = view;
+    strip.RF.original_height = rows;
+    dd_accumulate(strip.RF.ystart, strip.RF.ystart_lo, y0 * view.RF.ydelta);
+
+    render_key(p_model, strip);
+    ok = png.addRows(p_model->frameImage().getPixelsPtr(), rows);
+    std::cout << "rows " << y0 + rows << "/" << height << std::endl;
+  }
+  ok = png.close() && ok;
+  double secs = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  if (ok)
+    std::cout << filename << " in " << secs << " s" << std::endl;
+  else
+    std::cout << "could not write " << filename << std::endl;
+
+  workers.terminate();
+  for (auto &t : threads) t.join();
+  return ok ? 0 : -1;
+}
@@ -3,6 +3,17 @@
 #include <string>
 #include <vector>
 #include <complex>
+// Escape time formula the cpu workers run (see the kernel registry in
+// fractal_engine.h), buddhabrots ignore it
+enum class FractalFormula {
+  MANDELBROT,
+  SPIRAL_SEPTAGON,
+  NOVA_Z6,
+  NEWTON_Z6,
+  NEWTON_POLY,  // current_poly
+  NOVA_POLY
+};
+
 struct SupportedFractal {
   std::string name;
   bool cuda_mode;
@@ -19,6 +30,13 @@ struct SupportedFractal {
   std::complex<double> default_zconst;
   double current_escape_r;
   double default_escape_r;
+  FractalFormula formula = FractalFormula::MANDELBROT;
+  // buddhabrot linear sampling window {xmin, xmax, ymin, ymax} when it is
+  // not xMinMax/yMinMax (empty)
+  std::vector<double> sample_window = {};
+  // NEWTON_POLY/NOVA_POLY coefficients, highest power first
+  std::vector<std::complex<double>> current_poly = {};
+  std::vector<std::complex<double>> default_poly = {};
 };
 
 struct SampleStats {
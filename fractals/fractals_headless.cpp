@@ -0,0 +1,37 @@
+#include "fractal_engine.h"
+
+using namespace std;
+
+// The engine's batch modes without a window or tgui (servers, scripts, ci):
+//   fractals_headless benchmark [results.json] [threads,threads,...]
+//   fractals_headless animate <frames> <output prefix> <key> <key> ...
+//   fractals_headless zoom_movie <frames> <output prefix> <key> <key> ...
+//   fractals_headless poster <width> <height> <key> <output.png>
+// fractals_with_gui_cuda accepts the same modes.
+
+int main(int argc, char **argv) {
+  if (std::is_trivially_copyable<SavedFractal>::value == false) {
+    cout << "SavedFractal not serializable\n";
+    return -1;
+  }
+  if (!poly_roots_check()) {
+    cout << "poly_roots does not find polynomial roots\n";
+    return -1;
+  }
+
+  signal(SIGINT, signal_callback_handler);
+
+  std::string mode = (argc > 1) ? argv[1] : "";
+  if (mode == "benchmark") return run_benchmark(argc, argv);
+  if ((mode == "animate") || (mode == "zoom_movie"))
+    return run_animation(argc, argv);
+  if (mode == "poster") return run_poster(argc, argv);
+
+  cout << "usage: " << argv[0]
+       << " benchmark [results.json] [threads,threads,...]\n"
+       << "       " << argv[0]
+       << " animate|zoom_movie <frames> <output prefix> <key> <key> ...\n"
+       << "       " << argv[0] << " poster <width> <height> <key> <output.png>"
+       << endl;
+  return -1;
+}
@@ -4,6 +4,7 @@ import math
 import sys
 import subprocess
 import argparse
+import struct
 from ctypes import *
 from tabnanny import filename_only
 from PIL import Image
@@ -11,7 +12,7 @@ import glob
 import moviepy.video.io.ImageSequenceClip
 
 class SavedFractal(Structure):
-    """Shared between C and Python via ctypes and a .key file. Controls Fractal Generation. This is sensitive to small changes in the C code."""
+    """Version 1 key: the raw C struct written to a .key file. Only used to read old keys, see read_fractal_key."""
     _fields_ = [ 
     ('version',c_int),
     ('valid',c_int),
@@ -51,24 +52,134 @@ class SavedFractal(Structure):
     ]
 
 
+# Tagged key format (version 2+), same as KeyField in fractal_engine.h:
+# b"FKEY", u16 version, then records of u16 field id, u16 length, little endian
+# payload, ending with field id 0. Unknown ids are kept and written back.
+KEY_MAGIC = b"FKEY"
+KEY_FORMAT_VERSION = 2
+KEY_FIELDS = {
+    1: ('current_fractal', '<I'),
+    2: ('fractal_name', 'str'),
+    3: ('current_max_iters0', '<I'),
+    4: ('current_max_iters1', '<I'),
+    5: ('current_max_iters2', '<I'),
+    6: ('current_power', '<d'),
+    7: ('current_zconst0', '<d'),
+    8: ('current_zconst1', '<d'),
+    9: ('current_escape_r', '<d'),
+    10: ('poly', 'str'),
+    20: ('theta', '<d'),
+    21: ('xstart', '<d'),
+    22: ('ystart', '<d'),
+    23: ('xdelta', '<d'),
+    24: ('ydelta', '<d'),
+    25: ('current_width', '<d'),
+    26: ('current_height', '<d'),
+    27: ('displayed_zoom', '<d'),
+    28: ('requested_zoom', '<d'),
+    29: ('coloring_algo', '<I'),
+    30: ('color_cycle_size', '<i'),
+    31: ('palette', '<I'),
+    32: ('reflect_palette', '<?'),
+    33: ('escape_image_w', '<I'),
+    34: ('escape_image_h', '<I'),
+    35: ('image_loaded', '<?'),
+    36: ('light_pos_r', '<d'),
+    37: ('light_pos_i', '<d'),
+    38: ('light_angle', '<d'),
+    39: ('light_height', '<d'),
+    40: ('random_sample', '<?'),
+    41: ('original_width', '<d'),
+    42: ('original_height', '<d'),
+    43: ('palette_offset', '<d'),
+    44: ('xstart_lo', '<d'),
+    45: ('ystart_lo', '<d'),
+}
+KEY_IDS = {name: (fid, fmt) for fid, (name, fmt) in KEY_FIELDS.items()}
+
+
+class FractalKey:
+    """Fields of a fractal key by name (key.xstart), plus any field ids this script does not know."""
+    def __init__(self):
+        object.__setattr__(self, 'fields', {})
+        object.__setattr__(self, 'unknown', [])
+
+    def __getattr__(self, name):
+        try:
+            return self.fields[name]
+        except KeyError:
+            raise AttributeError(name)
+
+    def __setattr__(self, name, value):
+        if name not in KEY_IDS:
+            raise AttributeError("no key field " + name)
+        self.fields[name] = value
+
+
+def decode_fractal_key(data):
+    """Parse tagged key bytes into a FractalKey."""
+    if data[:4] != KEY_MAGIC:
+        raise ValueError("not a tagged fractal key")
+    key = FractalKey()
+    at = 6
+    while at + 4 <= len(data):
+        fid, length = struct.unpack_from('<HH', data, at)
+        at += 4
+        if fid == 0:
+            return key
+        payload = data[at:at + length]
+        at += length
+        if fid not in KEY_FIELDS:
+            key.unknown.append((fid, payload))
+            continue
+        name, fmt = KEY_FIELDS[fid]
+        if fmt == 'str':
+            key.fields[name] = payload.decode('utf-8')
+        else:
+            key.fields[name] = struct.unpack(fmt, payload)[0]
+    raise ValueError("truncated fractal key")
+
+
+def encode_fractal_key(key):
+    data = bytearray(KEY_MAGIC + struct.pack('<H', KEY_FORMAT_VERSION))
+    for name, value in key.fields.items():
+        fid, fmt = KEY_IDS[name]
+        payload = value.encode('utf-8') if fmt == 'str' else struct.pack(fmt, value)
+        data += struct.pack('<HH', fid, len(payload)) + payload
+    for fid, payload in key.unknown:
+        data += struct.pack('<HH', fid, len(payload)) + payload
+    data += struct.pack('<HH', 0, 0)
+    return bytes(data)
+
+
+def read_fractal_key(input_key_name):
+    """Read a tagged key, or convert a version 1 (raw struct) key."""
+    with open(input_key_name, "rb") as g:
+        data = g.read()
+    if data[:4] == KEY_MAGIC:
+        return decode_fractal_key(data)
+    legacy = SavedFractal.from_buffer_copy(data[:sizeof(SavedFractal)])
+    key = FractalKey()
+    for field_name, field_type in legacy._fields_:
+        if field_name in KEY_IDS:
+            key.fields[field_name] = getattr(legacy, field_name)
+    return key
+
+
+def write_fractal_key(f, key):
+    f.write(encode_fractal_key(key))
+
+
 def os_setup():
     """Go to where the fractals generator is."""
     #os.chdir(r"Documents/GitHub/demo/fractals/fractals_cuda/x64/Release")
     os.chdir(r"fractals_cuda/x64/Release")
     print("Currently in dir: ", os.getcwd())
 
-def read_fractal_key(input_key_name):
-    """Use ctypes to create a python data structure from the binary file."""
-    g = open(input_key_name,"rb")
-    output_key = SavedFractal()
-    g.readinto(output_key)
-    g.close()
-    return output_key
-
 def fileio_setup():
     """Set up input files, output files and temporary filenames."""
     global key_version, seedkey_name, changedkey_name, png_basename, frame_basename, final_basename, key_location
-    key_version = ".fractal_key_version_1"
+    key_version = ".fractal_key_version_2"
     # full file names
     seedkey_name="movie_base" + key_version
     changedkey_name = "changed_key" + key_version
@@ -79,9 +190,9 @@ def fileio_setup():
     key_location="../../../"
     
     fkey = read_fractal_key(key_location + seedkey_name)
-    print("\n\n{} data layout from ctypes:".format(key_version))
-    for field_name, field_type in fkey._fields_:
-        print(field_name, getattr(fkey, field_name))
+    print("\n\n{} fields:".format(key_version))
+    for field_name, value in fkey.fields.items():
+        print(field_name, value)
 
 def create_evolved_frames():
     count = args.tf
@@ -115,7 +226,7 @@ def create_evolved_frames():
         currentkey.light_pos_r = x
         currentkey.light_pos_i = y
 
-        f.write(currentkey)
+        write_fractal_key(f, currentkey)
         f.close()
         print("Wrote evolved key: ",key_location + framekey_name)
         pngname=png_basename + str(j) + ".png"
@@ -126,6 +237,28 @@ def create_evolved_frames():
         # this exports the new changedkey into a file
 
 
+def create_interpolated_frames(keyframes):
+    """Let the renderer interpolate from the seed key through keyframes and write every png in one run"""
+    keys = [key_location + seedkey_name] + keyframes
+    print("Rendering {} frames through: {}".format(args.tf, keys))
+    mode = 'zoom_movie' if args.reuse else 'animate'
+    subprocess.run(['fractals_cuda.exe', mode, str(args.tf), png_basename] + keys, shell=True)
+
+
+def stream_interpolated_movie(keyframes, movie_name):
+    """Pipe the renderer's y4m frames (output prefix -) straight into ffmpeg, no pngs"""
+    import imageio_ffmpeg  # the ffmpeg moviepy uses
+    keys = [key_location + seedkey_name] + keyframes
+    print("Streaming {} frames through: {}".format(args.tf, keys))
+    mode = 'zoom_movie' if args.reuse else 'animate'
+    renderer = subprocess.Popen(['fractals_cuda.exe', mode, str(args.tf), '-'] + keys,
+                                stdout=subprocess.PIPE, shell=True)
+    subprocess.run([imageio_ffmpeg.get_ffmpeg_exe(), '-y', '-i', '-', '-c:v', 'libx264',
+                    '-pix_fmt', 'yuv420p', movie_name + ".mp4"], stdin=renderer.stdout)
+    renderer.stdout.close()
+    renderer.wait()
+
+
 def create_gif():
     # Create the frames
     frames = []
@@ -155,6 +288,9 @@ def main():
     parser.add_argument("z", type=float, help="zoom in z times")
     parser.add_argument("tf", type=int, help="total frames")
     parser.add_argument("--tg", type=int, default=20,  help="time in seconds for gif")    
+    parser.add_argument("--keyframes", nargs="+", help="zoom from the seed key through these keys inside the renderer (lr and z are ignored)")
+    parser.add_argument("--reuse", action="store_true", help="with --keyframes: resample frames from oversized keyframes instead of rendering each one")
+    parser.add_argument("--y4m", action="store_true", help="with --keyframes: stream raw video from the renderer into ffmpeg, only the 30 fps movie is made (no pngs or gif)")
     args = parser.parse_args()
     
     for i in range(len(sys.argv)):
@@ -164,11 +300,18 @@ def main():
     fileio_setup()
  
 
-    #starts with movie_base.fractal_key_version_1 in demo/fractals directory
+    #starts with movie_base.fractal_key_version_2 in demo/fractals directory
     #finishes with 3 output files in fractals_cuda/x64/Release
     # check into top level dir if they look good
     
-    create_evolved_frames()
+    if args.keyframes and args.y4m:
+        stream_interpolated_movie(args.keyframes, final_basename + "_fast")
+        return
+
+    if args.keyframes:
+        create_interpolated_frames(args.keyframes)
+    else:
+        create_evolved_frames()
 
     create_gif()
 
@@ -178,9 +321,11 @@ def main():
     imgs = sorted(glob.glob(png_basename+"*.png"), key=os.path.getmtime)
     for i in range(len(imgs)):
         os.remove(imgs[i]) 
-        framekey_name=key_location + frame_basename + str(i) + key_version
-        os.remove(framekey_name)
-    os.remove(changedkey_name)
+        if not args.keyframes:
+            framekey_name=key_location + frame_basename + str(i) + key_version
+            os.remove(framekey_name)
+    if not args.keyframes:
+        os.remove(changedkey_name)
 
 if __name__=="__main__":
     main()
\ No newline at end of file